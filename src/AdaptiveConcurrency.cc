@@ -0,0 +1,68 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "AdaptiveConcurrency.h"
+
+void seuss::AdaptiveConcurrency::Configure(uint16_t initial, uint16_t max) {
+  max_ = (max > 0) ? max : 1;
+  limit_ = (initial > max_) ? max_ : initial;
+  if (limit_ == 0)
+    limit_ = 1;
+  samples_ = 0;
+  slowdown_sum_ = 0;
+  queue_max_us_ = 0;
+}
+
+void seuss::AdaptiveConcurrency::ObserveQueueDelay(uint64_t queue_us) {
+  if (queue_us > queue_max_us_)
+    queue_max_us_ = queue_us;
+}
+
+void seuss::AdaptiveConcurrency::ObserveRunLatency(size_t fid,
+                                                   uint64_t run_us) {
+  if (run_us == 0)
+    run_us = 1;
+  auto it = baseline_.find(fid);
+  if (it == baseline_.end()) {
+    if (baseline_.size() >= concurrency_baseline_limit)
+      return;
+    it = baseline_.emplace(fid, baseline{run_us, windows_}).first;
+  } else if (run_us < it->second.run_us) {
+    it->second.run_us = run_us;
+  } else {
+    it->second.run_us +=
+        (run_us - it->second.run_us) / concurrency_baseline_decay;
+  }
+  it->second.last_window = windows_;
+  slowdown_sum_ += (run_us * 100) / it->second.run_us;
+  if (++samples_ >= limit_)
+    end_window();
+}
+
+void seuss::AdaptiveConcurrency::end_window() {
+  auto slowdown = slowdown_sum_ / samples_;
+  if (slowdown > concurrency_slowdown_tolerance) {
+    // Instances are contending; back off
+    uint16_t cut = limit_ / concurrency_backoff;
+    limit_ -= (cut > 0) ? cut : 1;
+    if (limit_ == 0)
+      limit_ = 1;
+  } else if (queue_max_us_ > concurrency_queue_threshold_us &&
+             limit_ < max_) {
+    // Work is waiting and run times are healthy; probe for more
+    limit_++;
+  }
+  samples_ = 0;
+  slowdown_sum_ = 0;
+  queue_max_us_ = 0;
+  // Forget the functions that have not run in a while
+  if (++windows_ % concurrency_baseline_max_age == 0) {
+    for (auto it = baseline_.begin(); it != baseline_.end();) {
+      if (windows_ - it->second.last_window >= concurrency_baseline_max_age)
+        it = baseline_.erase(it);
+      else
+        ++it;
+    }
+  }
+}
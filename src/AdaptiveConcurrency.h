@@ -0,0 +1,71 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_ADAPTIVE_CONCURRENCY_H
+#define SEUSS_ADAPTIVE_CONCURRENCY_H
+
+#include <cstdint>
+#include <unordered_map>
+
+namespace seuss {
+
+/* Largest allowed slowdown (run time over the function's best run time, in
+ * percent) before the limit is cut */
+const uint32_t concurrency_slowdown_tolerance = 200;
+/* Queue delay above which waiting work justifies a larger limit */
+const uint64_t concurrency_queue_threshold_us = 1000;
+/* Multiplicative decrease: limit -= limit / concurrency_backoff */
+const uint16_t concurrency_backoff = 8;
+/* Run-time baselines rise towards slower runs by 1/N of the difference per
+ * sample, so a function whose runs get slower for good stops looking slowed
+ * down */
+const uint16_t concurrency_baseline_decay = 64;
+/* Baselines of functions not run for this many windows are dropped, and at
+ * most this many functions have one */
+const uint32_t concurrency_baseline_max_age = 1024;
+const size_t concurrency_baseline_limit = 1024;
+
+/* seuss::AdaptiveConcurrency
+ * Per-core AIMD controller for the number of in-flight invocations.
+ * Samples are grouped into windows of `limit` run latencies. A window with
+ * a mean slowdown (over the function's recent best run time) above the
+ * tolerance cuts the limit multiplicatively, otherwise queued work grows the
+ * limit by one.
+ */
+class AdaptiveConcurrency {
+public:
+  AdaptiveConcurrency(uint16_t initial, uint16_t max)
+      : limit_(initial), max_(max) {}
+
+  /* Current concurrency limit */
+  uint16_t Limit() const { return limit_; }
+
+  /* Adjust the bounds of the limit (from boot arguments) */
+  void Configure(uint16_t initial, uint16_t max);
+
+  /* Time a request spent waiting on the node before it was started */
+  void ObserveQueueDelay(uint64_t queue_us);
+
+  /* Run latency of a finished invocation of function fid */
+  void ObserveRunLatency(size_t fid, uint64_t run_us);
+
+private:
+  void end_window();
+  uint16_t limit_;
+  uint16_t max_;
+  /* current window */
+  uint16_t samples_ = 0;
+  uint64_t slowdown_sum_ = 0;
+  uint64_t queue_max_us_ = 0;
+  uint32_t windows_ = 0;
+  /* run-time baseline of each function: a minimum that decays upwards */
+  struct baseline {
+    uint64_t run_us;
+    uint32_t last_window;
+  };
+  std::unordered_map<size_t, baseline> baseline_;
+}; // end class AdaptiveConcurrency
+
+} // end namespace seuss
+#endif
@@ -2,193 +2,348 @@
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
+#include <algorithm> /* std::remove, std::transform */
+#include <cstring> /* strlen */
 #include <iostream>
 
+#include <ebbrt/StaticIOBuf.h>
+
+#include "Log.h"
 #include "SeussInvoker.h"
 
+/* Keep a copy of the last request for failure reports */
+#define DEBUG_HTTP_REQUEST 0
+
 #define kprintf ebbrt::kprintf
 using ebbrt::kprintf_force;
 
+namespace {
+/* http request templates */
+const size_t http_header_max = 256;
+const char *http_post_header = "POST %s HTTP/1.0\r\n"
+                               "Content-Type: application/json\r\n"
+                               "%s"
+                               "content-length: %zu\r\n\r\n"
+                               "%s";
+const char *http_keep_alive = "Connection: keep-alive\r\n";
+const char *http_init_prefix = "{\"value\": {\"main\":\"main\", \"code\":\"";
+const char *http_init_suffix = "\"}}";
+const char *http_run_prefix = "{\"value\": ";
+const char *http_run_suffix = "}";
+} // end local namespace
+
 /* seuss::InvocationSession */
 
 void seuss::InvocationSession::Connect() {
   // Kick off the connection with the UMI 
   ebbrt::kbugon(is_connected_); // Or maybe just return?
   ebbrt::kbugon(!src_port_);
+  ebbrt::kbugon(!handler_);
+  enter_phase(Phase::connect);
   Pcb().Connect(umm::UmInstance::CoreLocalIp(), 8080, src_port_);
-  auto now = ebbrt::clock::Wall::Now();
-  timeout_ = now + std::chrono::milliseconds(5000); // 5000ms
-  enable_timer(now);
+  enable_timer(default_connect_timeout_ms);
 }
 
 void seuss::InvocationSession::Connected() {
   // We've established a connection with the instance
   //kprintf(GREEN "SESSION ESTABLISHED (%u)\n" RESET, src_port_);
   is_connected_ = true;
-  disable_timer();
-  auto now = ebbrt::clock::Wall::Now();
-  timeout_ = now + std::chrono::seconds(60); // 60 seconds to finish invocation
-  enable_timer(now);
-  ebbrt::event_manager->SpawnLocal([this]() { when_connected_.SetValue(); });
+  enable_timer(run_timeout_ms()); // time to finish the invocation
+  handler_->SessionConnected(this);
 }
 
 void seuss::InvocationSession::Close() {
   //kprintf(YELLOW "SESSION CLOSED (%u)\n" RESET, src_port_);
+  /* A response without a content-length ends when the connection closes */
+  if (header_complete_ && !has_content_length_) {
+    complete_response();
+  }
   disable_timer();
   is_connected_ = false;
+  if (phase_ != Phase::finished)
+    enter_phase(Phase::close);
   Pcb().Disconnect();
-  ebbrt::event_manager->SpawnLocal([this]() { when_closed_.SetValue(); });
+  handler_->SessionClosed(this);
 }
 
 void seuss::InvocationSession::Abort() {
   disable_timer();
   is_connected_ = false;
-  ebbrt::event_manager->SpawnLocal([this]() { when_aborted_.SetValue(); });
+  handler_->SessionAborted(this);
 }
 
 void seuss::InvocationSession::Finish(bool status) {
   disable_timer();
+  enter_phase(Phase::finished);
   when_finished_.SetValue(status);
 }
 
+void seuss::InvocationSession::Rearm() {
+  when_finished_ = ebbrt::Promise<bool>();
+  is_parked_ = false;
+  is_executed_ = false;
+  phase_ = Phase::start;
+}
+
+void seuss::InvocationSession::Disconnect() {
+  if (!is_connected_)
+    return;
+  is_connected_ = false;
+  Pcb().Disconnect();
+}
+
+void seuss::InvocationSession::Reuse() {
+  // The connection can close between the hot start and this event
+  if (!is_connected_) {
+    handler_->SessionAborted(this);
+    return;
+  }
+  enable_timer(run_timeout_ms()); // time to finish the invocation
+  handler_->SessionConnected(this);
+}
+
 void seuss::InvocationSession::Receive(std::unique_ptr<ebbrt::MutIOBuf> b) {
-  ebbrt::kbugon(b->IsChained());
+  /* Response headers may be split across segments and Receive() calls */
+  if (!header_complete_) {
+    for (auto &buf : *b) {
+      auto len = buf.Length();
+      if (len == 0)
+        continue;
+      auto prev = response_header_.size();
+      response_header_.append(reinterpret_cast<const char *>(buf.Data()), len);
+      auto end = response_header_.find("\r\n\r\n", (prev > 3) ? prev - 3 : 0);
+      if (end == std::string::npos) {
+        buf.Advance(len);
+        continue;
+      }
+      // Leave only body bytes in the buffer
+      auto header_len = end + 4;
+      buf.Advance(header_len - prev);
+      response_header_.resize(header_len);
+      parse_response_header();
+      break;
+    }
+    if (!header_complete_)
+      return;
+  }
+
+  /* Everything else is body, keep the segments chained (no copy) */
+  auto len = b->ComputeChainDataLength();
+  if (len > 0) {
+    body_received_ += len;
+    if (response_body_) {
+      response_body_->PrependChain(std::move(b));
+    } else {
+      response_body_ = std::move(b);
+    }
+  }
+  if (!has_content_length_ || body_received_ < content_length_)
+    return;
+  complete_response();
+}
+
+void seuss::InvocationSession::parse_response_header() {
+  header_complete_ = true;
+  // case-insensitive search for the content-length header
+  std::string lower = response_header_;
+  std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+  auto loc = lower.find("\r\ncontent-length:");
+  if (loc != std::string::npos) {
+    has_content_length_ = true;
+    content_length_ = strtoul(lower.c_str() + loc + 17, nullptr, 10);
+  }
+}
+
+void seuss::InvocationSession::complete_response() {
+  /* Reassemble the body from the chain */
+  std::string response;
+  response.reserve(body_received_);
+  if (response_body_) {
+    for (auto &buf : *response_body_) {
+      response.append(reinterpret_cast<const char *>(buf.Data()),
+                      buf.Length());
+    }
+  }
+  if (has_content_length_ && response.size() > content_length_)
+    response.resize(content_length_);
+  std::string http_status =
+      response_header_.substr(0, response_header_.find_first_of("\r"));
+  // Ready for the next response on this connection
+  response_header_.clear();
+  response_body_.reset();
+  header_complete_ = false;
+  has_content_length_ = false;
+  content_length_ = 0;
+  body_received_ = 0;
 
-  /* construct a string of the response message */
-  std::string reply(reinterpret_cast<const char *>(b->Data()), b->Length());
-  std::string response = reply.substr(reply.find_first_of("{"));
-  std::string http_status = reply.substr(0, reply.find_first_of("\r"));
+  /* The request is complete, stop its clock before calling the handler */
+  account_phase();
 
   /* Verify if the http request was successful */
   if (http_status != "HTTP/1.1 200 OK") {
+#if DEBUG_HTTP_REQUEST
     kprintf_force(RED "REQUEST FAILED!\n REQUEST: %s\nRESPONSE: %s\n",
                   previous_request_.c_str(), response.c_str());
+#else
+    kprintf_force(RED "REQUEST FAILED!\nRESPONSE: %s\n", response.c_str());
+#endif
     reply_ = response;
-    when_aborted_.SetValue();
-    // XXX: Not sure about this disconnect
-    Pcb().Disconnect();
+    handler_->SessionAborted(this);
+    Disconnect();
+    return;
   }
   /* An {"OK":true} response signals a completed INIT */
   if (response == R"({"OK":true})" && !is_initialized_) {
     is_initialized_ = true;
-    when_initialized_.SetValue();
+    handler_->SessionInitialized(this);
   } else {
     /* Any other response signals a completed RUN */
-    reply_ = response;
-    when_executed_.SetValue();
+    reply_ = std::move(response);
+    is_executed_ = true;
+    handler_->SessionExecuted(this);
   }
 }
 
-void seuss::InvocationSession::enable_timer(ebbrt::clock::Wall::time_point now) {
-  if (timer_set || (now >= timeout_)) {
-    return;
-  }
-  auto duration =
-      std::chrono::duration_cast<std::chrono::microseconds>(timeout_ - now);
-  ebbrt::timer->Start(*this, duration, /* repeat = */ false);
-  timer_set = true;
+void seuss::InvocationSession::enable_timer(uint32_t timeout_ms) {
+  // Re-arming replaces any pending timeout
+  seuss::invoker->Timeouts().Arm(*this, std::chrono::milliseconds(timeout_ms));
 }
 
 void seuss::InvocationSession::disable_timer() {
-  if (timer_set) {
-    ebbrt::timer->Stop(*this);
+  if (IsArmed()) {
+    seuss::invoker->Timeouts().Cancel(*this);
   }
-  timer_set = false;
-  timeout_ = ebbrt::clock::Wall::time_point(); // clear timer
 }
 
-void seuss::InvocationSession::Fire() {
-  if (timer_set) {
-    kprintf_force(RED "\nC%d: InvocationSession Timed Out\n" RESET,
-                  (size_t)ebbrt::Cpu::GetMine());
-  }
-  timer_set = false;
-  // Confirm time is valid and has expired  
+void seuss::InvocationSession::enter_phase(Phase p) {
+  account_phase();
+  phase_ = p;
+}
+
+void seuss::InvocationSession::account_phase() {
+  if (phase_clock_ == ebbrt::clock::Wall::time_point())
+    return;
   auto now = ebbrt::clock::Wall::Now();
-  if (timeout_ != ebbrt::clock::Wall::time_point() && now >= timeout_) {
-    timeout_ = ebbrt::clock::Wall::time_point(); // clear the time
-    // Abort the connection, causing the InvocationSession to fail
-    Abort();
+  uint32_t us = std::chrono::duration_cast<std::chrono::microseconds>(
+                    now - phase_clock_)
+                    .count();
+  phase_clock_ = now;
+  auto &t = istats_.exec.us;
+  switch (phase_) {
+  case Phase::load:
+    t.load += us;
+    break;
+  case Phase::start:
+    t.start += us;
+    break;
+  case Phase::connect:
+    t.connect += us;
+    break;
+  case Phase::init:
+    t.init += us;
+    break;
+  case Phase::run:
+    t.run += us;
+    break;
+  default:
+    // time after the response (close, finished) is not reported
+    break;
   }
 }
 
-void seuss::InvocationSession::SendHttpRequest(std::string path,
-                                               std::string payload, bool keep_alive) {
-  kassert(payload.size() > 0);
-  std::string msg;
-  msg = http_post_request(path, payload, keep_alive);
-  auto buf = ebbrt::MakeUniqueIOBuf(msg.size());
-  auto dp = buf->GetMutDataPointer();
-  auto str_ptr = reinterpret_cast<char *>(dp.Data());
-  msg.copy(str_ptr, msg.size());
-
-  if (path == "/init") {
-    init_start_time_ = ebbrt::clock::Wall::Now();
-  } else if (path == "/run") {
-    run_start_time_ = ebbrt::clock::Wall::Now();
-  }
+uint32_t seuss::InvocationSession::run_timeout_ms() {
+  return istats_.timeout_ms ? istats_.timeout_ms : default_run_timeout_ms;
+}
 
-  Send(std::move(buf));
+void seuss::InvocationSession::Expire() {
+  SEUSS_LOG_WARN("C%lu: InvocationSession Timed Out (tid=%lx)\n",
+                 (size_t)ebbrt::Cpu::GetMine(), istats_.transaction_id);
+  // Abort the connection, causing the InvocationSession to fail
+  Disconnect();
+  Abort();
 }
 
-void seuss::InvocationSession::reset_pcb_internal(){
-  //HACK: overwrite the old Pcb with a new one, destoying the old one
-  ebbrt::NetworkManager::TcpPcb *pcb = (ebbrt::NetworkManager::TcpPcb *) &Pcb();
-  *pcb = ebbrt::NetworkManager::TcpPcb();
-  Install();
+void seuss::InvocationSession::SetPayload(std::string args, std::string code) {
+  args_ = std::move(args);
+  code_ = std::move(code);
+  // Newlines are not allowed inside the JSON string, strip them in place
+  args_.erase(std::remove(args_.begin(), args_.end(), '\n'), args_.end());
+  code_.erase(std::remove(code_.begin(), code_.end(), '\n'), code_.end());
 }
 
-std::string
-seuss::InvocationSession::http_post_request(std::string path, std::string msg,
-                                            bool keep_alive = false) {
+void seuss::InvocationSession::SendHttpRequest(std::string path,
+                                               bool keep_alive) {
   // construct json payload formatted for the OpenWhisk ActonRunner
-  std::ostringstream payload;
-  std::ostringstream ret;
-
-  msg.erase(std::remove(msg.begin(), msg.end(), '\n'), msg.end());
-  payload << "{\"value\": ";
-  if (path == "/init" || path == "/preInit") {
-    payload << "{\"main\":\"main\", \"code\":\"" << msg << "\"}}";
-  } else {
-    payload << msg << "}";
-  }
-  // build http message header + body
-  auto body = payload.str();
-  // TODO: avoid locking operation
-  ret << "POST " << path << " HTTP/1.0\r\n"
-      << "Content-Type: application/json\r\n";
-  if (keep_alive)
-    ret << "Connection: keep-alive\r\n";
-  ret << "content-length: " << body.size() << "\r\n\r\n" << body;
-  std::string return_val = ret.str();
-  previous_request_ = return_val;
-  return return_val;
-}
+  bool is_init = (path == "/init" || path == "/preInit");
+  const std::string &payload = is_init ? code_ : args_;
+  const char *body_prefix = is_init ? http_init_prefix : http_run_prefix;
+  const char *body_suffix = is_init ? http_init_suffix : http_run_suffix;
+  kassert(payload.size() > 0);
+  size_t body_len =
+      strlen(body_prefix) + payload.size() + strlen(body_suffix);
 
-/* Future-based Lambda Handlers */
+  // http header and body prefix are written into a small buffer
+  auto buf = ebbrt::MakeUniqueIOBuf(http_header_max);
+  auto dp = buf->GetMutDataPointer();
+  auto str_ptr = reinterpret_cast<char *>(dp.Data());
+  auto len = snprintf(str_ptr, http_header_max, http_post_header, path.c_str(),
+                      keep_alive ? http_keep_alive : "", body_len, body_prefix);
+  kassert(len > 0 && (size_t)len < http_header_max);
+  buf->TrimEnd(http_header_max - len);
 
-ebbrt::SharedFuture<void> seuss::InvocationSession::WhenAborted(){
-  return when_aborted_.GetFuture().Share();
-}
+  // payload (owned by the session) and suffix are chained without a copy
+  std::unique_ptr<ebbrt::IOBuf> msg = std::move(buf);
+  msg->PrependChain(std::make_unique<ebbrt::StaticIOBuf>(
+      reinterpret_cast<const uint8_t *>(payload.data()), payload.size()));
+  msg->PrependChain(std::make_unique<ebbrt::StaticIOBuf>(body_suffix));
+#if DEBUG_HTTP_REQUEST
+  previous_request_ = std::string(str_ptr, len) + payload + body_suffix;
+#endif
 
-ebbrt::SharedFuture<void> seuss::InvocationSession::WhenConnected(){
-  return when_connected_.GetFuture().Share();
-}
+  if (path == "/init") {
+    enter_phase(Phase::init);
+  } else if (path == "/run") {
+    enter_phase(Phase::run);
+  }
 
-ebbrt::SharedFuture<void> seuss::InvocationSession::WhenClosed(){
-  return when_closed_.GetFuture().Share();
+  Send(std::move(msg));
 }
 
-ebbrt::SharedFuture<void> seuss::InvocationSession::WhenExecuted(){
-  return when_executed_.GetFuture().Share();
+void seuss::InvocationSession::Reset(uint16_t src_port,
+                                     ebbrt::NetworkManager::TcpPcb pcb) {
+  disable_timer();
+  reset_pcb_internal(std::move(pcb));
+  Pcb().BindCpu((size_t)ebbrt::Cpu::GetMine()); // Bind connection to *this* core
+  Rearm();
+  src_port_ = src_port;
+  umi_id_ = 0;
+  phase_ = Phase::load;
+  phase_clock_ = ebbrt::clock::Wall::time_point();
+  is_connected_ = false;
+  is_initialized_ = false;
+  keep_alive_ = false;
+  is_parked_ = false;
+  is_prewarm_ = false;
+  istats_ = InvocationStats();
+  args_.clear();
+  code_.clear();
+  reply_.clear();
+  response_header_.clear();
+  response_body_.reset();
+  header_complete_ = false;
+  has_content_length_ = false;
+  content_length_ = 0;
+  body_received_ = 0;
 }
 
-ebbrt::SharedFuture<bool> seuss::InvocationSession::WhenFinished(){
-  return when_finished_.GetFuture().Share();
+void seuss::InvocationSession::reset_pcb_internal(
+    ebbrt::NetworkManager::TcpPcb pcb) {
+  //HACK: overwrite the old Pcb with a new one, destoying the old one
+  auto old = (ebbrt::NetworkManager::TcpPcb *)&Pcb();
+  *old = std::move(pcb);
+  Install();
 }
 
-ebbrt::SharedFuture<void> seuss::InvocationSession::WhenInitialized(){
-  return when_initialized_.GetFuture().Share();
+ebbrt::Future<bool> seuss::InvocationSession::WhenFinished() {
+  return when_finished_.GetFuture();
 }
-
-
@@ -7,14 +7,39 @@
 
 #include <ebbrt/Future.h>
 #include <ebbrt/native/NetTcpHandler.h>
-#include <ebbrt/Timer.h>
+
+#include "umm/src/Umm.h"
 
 #include "Seuss.h"
+#include "TimerWheel.h"
 
 namespace seuss {
 
-class InvocationSession : public ebbrt::TcpHandler, public ebbrt::Timer::Hook {
+class InvocationSession : public ebbrt::TcpHandler, public TimerWheel::Entry {
 public:
+  /* Invocation phases, in the order they occur */
+  enum class Phase : uint8_t {
+    load = 0, // loading the instance from snapshot
+    start,    // starting (or resuming) the instance
+    connect,  // establishing the TCP connection
+    init,     // waiting on the /init request
+    run,      // waiting on the /run request
+    close,    // waiting on connection close
+    finished
+  };
+
+  /* Phase handlers, called directly from the TCP and timer events of the
+   * session (no event hop). A handler must not free the session inline. */
+  class Handler {
+  public:
+    virtual ~Handler() {}
+    virtual void SessionConnected(InvocationSession *umsesh) = 0;
+    virtual void SessionInitialized(InvocationSession *umsesh) = 0;
+    virtual void SessionExecuted(InvocationSession *umsesh) = 0;
+    virtual void SessionClosed(InvocationSession *umsesh) = 0;
+    virtual void SessionAborted(InvocationSession *umsesh) = 0;
+  };
+
   InvocationSession(ebbrt::NetworkManager::TcpPcb pcb, uint16_t src_port )
       : ebbrt::TcpHandler(std::move(pcb)), src_port_(src_port) { 
     Install();  // Install PCB to TcpHandler
@@ -27,7 +52,7 @@ public:
   void Connect();
 
   /** Timeout event handler */
-  void Fire() override;
+  void Expire() override;
 
 // HACK!
 #if 0
@@ -36,21 +61,38 @@ public:
   }
 #endif
 
-  /* Sends an openwhisk NodeJsAction HTTP request */ 
-  void SendHttpRequest(std::string path, std::string payload, bool keep_alive=false);
+  /* Set the request payloads; the session owns them until they are sent */
+  void SetPayload(std::string args, std::string code = std::string());
+  bool HasCode() { return !code_.empty(); }
+
+  /* Sends an openwhisk NodeJsAction HTTP request, the payload is the code
+   * for /init and /preInit and the arguments otherwise */
+  void SendHttpRequest(std::string path, bool keep_alive=false);
 
   /* Signal that the invocation has finished; true=success, false=failure*/
   void Finish(bool);
 
-  void reset_pcb_internal();
+  /* Reset the finish hook so an idle keep-alive session can be reused */
+  void Rearm();
+
+  /* Start the next invocation on an established keep-alive connection,
+   * aborts the session if the instance has closed it in the meantime */
+  void Reuse();
+
+  /* Close our side of the connection, before its port is released */
+  void Disconnect();
+
+  void reset_pcb_internal(ebbrt::NetworkManager::TcpPcb pcb);
+
+  /* Return a finished session to its initial state, for reuse from a pool.
+   * A closed PCB can't connect again, the session takes a spare one. */
+  void Reset(uint16_t src_port, ebbrt::NetworkManager::TcpPcb pcb);
 
-  /* ebbrt::Future-based lambda handlers */
-  ebbrt::SharedFuture<void> WhenAborted();
-  ebbrt::SharedFuture<void> WhenClosed();
-  ebbrt::SharedFuture<void> WhenConnected();
-  ebbrt::SharedFuture<void> WhenExecuted();
-  ebbrt::SharedFuture<bool> WhenFinished(); // returns status (bool)
-  ebbrt::SharedFuture<void> WhenInitialized();
+  /* Set the handler of the session's phase transitions */
+  void SetHandler(Handler *handler) { handler_ = handler; }
+
+  /* Resolves once per invocation with the status passed to Finish() */
+  ebbrt::Future<bool> WhenFinished();
 
   /* ebbrt::TcpHandler Callbacks */
 
@@ -72,42 +114,74 @@ public:
   /* Return the sender port of the connection */
   uint16_t SrcPort(){ return src_port_; }
 
-  size_t  get_runtime() {
-    auto tp =  run_start_time_;
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               ebbrt::clock::Wall::Now() - tp)
-        .count();
-  }
+  /* Instance the session is connected to */
+  umm::umi::id InstanceId() { return umi_id_; }
+  void SetInstanceId(umm::umi::id umi_id) { umi_id_ = umi_id; }
 
-  size_t get_inittime() {
-    auto tp = init_start_time_;
-    return std::chrono::duration_cast<std::chrono::milliseconds>(
-               ebbrt::clock::Wall::Now() - tp)
-        .count();
+  /* Statistics of the invocation carried by this session, the time of the
+   * current phase is counted from when they are set */
+  InvocationStats &Stats() { return istats_; }
+  void SetStats(InvocationStats istats) {
+    istats_ = istats;
+    phase_clock_ = ebbrt::clock::Wall::Now();
   }
 
+  /* Current phase of the invocation */
+  Phase GetPhase() { return phase_; }
+  void SetPhase(Phase p) { enter_phase(p); }
+
+  /* Keep-alive sessions stay connected after the run */
+  bool KeepAlive() { return keep_alive_; }
+  void SetKeepAlive(bool k) { keep_alive_ = k; }
+  bool IsConnected() { return is_connected_; }
+
+  /* Has the /run response of the current invocation been received? */
+  bool IsExecuted() { return is_executed_; }
+
+  /* Parked sessions are idle, held with their hot instance */
+  bool IsParked() { return is_parked_; }
+  void SetParked(bool p) { is_parked_ = p; }
+
+  /* Prewarm sessions finish after /init, there is no /run */
+  bool IsPrewarm() { return is_prewarm_; }
+  void SetPrewarm(bool p) { is_prewarm_ = p; }
+
 private:
   /* event hooks */
-  ebbrt::Promise<void> when_aborted_;
-  ebbrt::Promise<void> when_closed_;
-  ebbrt::Promise<void> when_connected_;
-  ebbrt::Promise<void> when_executed_;
-  ebbrt::Promise<void> when_initialized_;
-  ebbrt::Promise<bool> when_finished_; 
+  Handler *handler_{nullptr};
+  ebbrt::Promise<bool> when_finished_;
   /* session members */
   bool is_connected_{false};
   bool is_initialized_{false};
+  bool is_executed_{false};
+  bool keep_alive_{false};
+  bool is_parked_{false};
+  bool is_prewarm_{false};
   uint16_t src_port_{0}; // dedicated sender port
+  umm::umi::id umi_id_{0};
+  Phase phase_{Phase::load};
+  InvocationStats istats_;
   /* time */
-  void enable_timer(ebbrt::clock::Wall::time_point now);
-  void disable_timer(); 
-  bool timer_set = false;
-  ebbrt::clock::Wall::time_point timeout_; // TIMEOUT
-  ebbrt::clock::Wall::time_point init_start_time_;
-  ebbrt::clock::Wall::time_point run_start_time_;
-  /* helper methods */
-  std::string http_post_request(std::string path, std::string payload, bool keep_alive);
-  std::string previous_request_;
+  void enable_timer(uint32_t timeout_ms);
+  void disable_timer();
+  uint32_t run_timeout_ms(); // per-action limit, if given
+  /* per-phase timing, into istats_.exec.us */
+  void enter_phase(Phase p);
+  void account_phase();
+  ebbrt::clock::Wall::time_point phase_clock_; // start of the current phase
+  /* incremental http response parsing */
+  void parse_response_header();
+  void complete_response();
+  std::string response_header_; // status line and headers
+  bool header_complete_{false};
+  bool has_content_length_{false};
+  size_t content_length_{0};
+  size_t body_received_{0};
+  std::unique_ptr<ebbrt::MutIOBuf> response_body_; // chained body segments
+  /* request payloads */
+  std::string args_;
+  std::string code_;
+  std::string previous_request_; // only kept with DEBUG_HTTP_REQUEST
   std::string reply_;
 }; // end class InvocationSession
 } // end namespace seuss
@@ -0,0 +1,68 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include "KeepAlivePolicy.h"
+
+void seuss::ArrivalHistogram::Record(ebbrt::clock::Wall::time_point now) {
+  if (has_arrival_) {
+    auto it_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                     now - last_arrival_)
+                     .count();
+    auto bin = it_ms / keep_alive_bin_ms;
+    if (bin < keep_alive_bin_count) {
+      bins_[bin]++;
+    } else {
+      out_of_bounds_++;
+    }
+    samples_++;
+  }
+  has_arrival_ = true;
+  last_arrival_ = now;
+}
+
+uint32_t seuss::ArrivalHistogram::percentile_bin(uint32_t in_range,
+                                                 uint8_t percentile) const {
+  // First bin at which the cumulative count reaches the percentile
+  uint64_t target = ((uint64_t)in_range * percentile + 99) / 100;
+  uint64_t count = 0;
+  for (uint32_t i = 0; i < keep_alive_bin_count; i++) {
+    count += bins_[i];
+    if (count >= target && count > 0)
+      return i;
+  }
+  return keep_alive_bin_count - 1;
+}
+
+seuss::KeepAliveWindow seuss::ArrivalHistogram::Window() const {
+  // Default: no pre-warm, keep alive for the whole histogram range
+  KeepAliveWindow window = {0, keep_alive_bin_ms * keep_alive_bin_count};
+
+  uint32_t in_range = samples_ - out_of_bounds_;
+  if (samples_ < keep_alive_min_samples || out_of_bounds_ > in_range) {
+    return window;
+  }
+
+  // Only trust histograms with a coefficient of variation (of the bin
+  // counts) of at least 2, i.e., variance >= 4 * mean^2
+  uint64_t sum_sq = 0;
+  for (auto c : bins_) {
+    sum_sq += (uint64_t)c * c;
+  }
+  uint64_t n = keep_alive_bin_count;
+  // variance * n^2 = n * sum(c^2) - sum(c)^2
+  uint64_t var_n2 = n * sum_sq - (uint64_t)in_range * in_range;
+  uint64_t mean_sq_n2 = (uint64_t)in_range * in_range;
+  if (var_n2 < 4 * mean_sq_n2) {
+    return window;
+  }
+
+  auto head = percentile_bin(in_range, keep_alive_head_percentile);
+  auto tail = percentile_bin(in_range, keep_alive_tail_percentile);
+  uint32_t head_ms = head * keep_alive_bin_ms * (100 - keep_alive_margin) / 100;
+  uint32_t tail_ms =
+      (tail + 1) * keep_alive_bin_ms * (100 + keep_alive_margin) / 100;
+  window.prewarm_ms = head_ms;
+  window.keep_alive_ms = tail_ms - head_ms;
+  return window;
+}
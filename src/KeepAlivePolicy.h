@@ -0,0 +1,57 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_KEEP_ALIVE_POLICY_H
+#define SEUSS_KEEP_ALIVE_POLICY_H
+
+#include <array>
+
+#include <ebbrt/Clock.h>
+
+namespace seuss {
+
+/* Inter-arrival histogram shape (1s bins, 4 minute range) */
+const uint32_t keep_alive_bin_ms = 1000;
+const uint16_t keep_alive_bin_count = 240;
+/* Arrivals needed before the histogram is trusted */
+const uint32_t keep_alive_min_samples = 8;
+/* Head and tail percentiles of the inter-arrival distribution */
+const uint8_t keep_alive_head_percentile = 5;
+const uint8_t keep_alive_tail_percentile = 99;
+/* Safety margin applied to the head and tail (percent) */
+const uint8_t keep_alive_margin = 10;
+/* How often each core reaps expired idle instances */
+const uint32_t keep_alive_reap_ms = 100;
+
+/** Per-function keep-alive decision */
+struct KeepAliveWindow {
+  uint32_t prewarm_ms;    // idle time before an instance is (re)loaded
+  uint32_t keep_alive_ms; // how long that instance is then kept around
+};
+
+/* seuss::ArrivalHistogram
+ * Tracks the inter-arrival times of a single function and derives its
+ * keep-alive window in the style of the hybrid histogram policy (Shahrad et
+ * al., ATC'20). Functions without a representative histogram fall back to
+ * keeping instances for the full histogram range.
+ */
+class ArrivalHistogram {
+public:
+  /* Record an arrival of this function */
+  void Record(ebbrt::clock::Wall::time_point now);
+
+  /* Current pre-warm and keep-alive windows for this function */
+  KeepAliveWindow Window() const;
+
+private:
+  uint32_t percentile_bin(uint32_t in_range, uint8_t percentile) const;
+  std::array<uint32_t, keep_alive_bin_count> bins_ = {};
+  uint32_t samples_ = 0;
+  uint32_t out_of_bounds_ = 0;
+  bool has_arrival_ = false;
+  ebbrt::clock::Wall::time_point last_arrival_;
+}; // end class ArrivalHistogram
+
+} // end namespace seuss
+#endif
@@ -0,0 +1,159 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <chrono>
+#include <cstdio>
+
+#include "Log.h"
+
+#ifdef __ebbrt__
+#include <ebbrt/Clock.h>
+#include <ebbrt/Cpu.h>
+#include <ebbrt/Debug.h>
+#include <ebbrt/Timer.h>
+#else
+#include <mutex>
+#include <thread>
+#include <vector>
+#endif
+
+seuss::log::Level seuss::log::level = seuss::log::warn;
+
+namespace {
+const size_t log_line_max = 256;
+const char *level_names[] = {"ERROR", "WARN", "INFO", "DEBUG"};
+
+void print_line(const char *line) {
+#ifdef __ebbrt__
+  ebbrt::kprintf_force("%s", line);
+#else
+  std::fputs(line, stdout);
+#endif
+}
+
+void print_record(const seuss::log::Record &r) {
+  char line[log_line_max];
+  auto len = snprintf(line, log_line_max, "[%s %lu.%06lu] ",
+                      level_names[r.level % 4], r.time_us / 1000000,
+                      r.time_us % 1000000);
+  // Unused arguments are ignored by the format
+  len += snprintf(line + len, log_line_max - len, r.fmt, r.args[0], r.args[1],
+                  r.args[2], r.args[3], r.args[4], r.args[5], r.args[6],
+                  r.args[7]);
+  if ((size_t)len >= log_line_max - 1) {
+    line[log_line_max - 2] = '\n';
+    line[log_line_max - 1] = '\0';
+  }
+  print_line(line);
+}
+
+#ifdef __ebbrt__
+/* Rings are created on (and only touched by) their own core */
+const size_t max_cores = 256;
+seuss::log::Ring *core_rings[max_cores];
+
+class Drainer : public ebbrt::Timer::Hook {
+public:
+  void Fire() override { seuss::log::Drain(seuss::log::Local()); }
+};
+#else
+/* Rings are created per thread and drained by a single thread */
+std::mutex rings_lock;
+std::vector<seuss::log::Ring *> thread_rings;
+bool drain_started = false;
+#endif
+} // end local namespace
+
+bool seuss::log::Ring::Pop(Record &r) {
+  auto tail = tail_.load(std::memory_order_relaxed);
+  if (tail == head_.load(std::memory_order_acquire))
+    return false;
+  r = records_[tail % ring_size];
+  tail_.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+uint64_t seuss::log::Ring::now_us() {
+#ifdef __ebbrt__
+  auto now = ebbrt::clock::Wall::Now().time_since_epoch();
+#else
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+#endif
+  return std::chrono::duration_cast<std::chrono::microseconds>(now).count();
+}
+
+seuss::log::Ring &seuss::log::Local() {
+#ifdef __ebbrt__
+  size_t core = ebbrt::Cpu::GetMine();
+  kassert(core < max_cores);
+  if (!core_rings[core])
+    core_rings[core] = new Ring();
+  return *core_rings[core];
+#else
+  thread_local Ring *ring = nullptr;
+  if (!ring) {
+    ring = new Ring();
+    std::lock_guard<std::mutex> guard(rings_lock);
+    thread_rings.push_back(ring);
+  }
+  return *ring;
+#endif
+}
+
+void seuss::log::Init(Level lvl) {
+  level = lvl;
+#ifdef __ebbrt__
+  Local();
+  auto drainer = new Drainer();
+  ebbrt::timer->Start(*drainer, std::chrono::milliseconds(drain_ms),
+                      /* repeat = */ true);
+#else
+  {
+    std::lock_guard<std::mutex> guard(rings_lock);
+    if (drain_started)
+      return;
+    drain_started = true;
+  }
+  std::thread([] {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(drain_ms));
+      std::vector<Ring *> rings;
+      {
+        std::lock_guard<std::mutex> guard(rings_lock);
+        rings = thread_rings;
+      }
+      for (auto ring : rings) {
+        Drain(*ring);
+      }
+      std::fflush(stdout);
+    }
+  }).detach();
+#endif
+}
+
+void seuss::log::Drain(Ring &ring) {
+  Record r;
+  while (ring.Pop(r)) {
+    print_record(r);
+  }
+  auto dropped = ring.TakeDropped();
+  if (dropped) {
+    char line[log_line_max];
+    snprintf(line, log_line_max, "[WARN] log ring full, dropped %lu records\n",
+             dropped);
+    print_line(line);
+  }
+}
+
+void seuss::log::Write(const Record &r) {
+#ifdef __ebbrt__
+  // This core is the only consumer of its ring
+  Drain(Local());
+  print_record(r);
+#else
+  // The ring belongs to the drain thread, earlier records may print later
+  print_record(r);
+  std::fflush(stdout);
+#endif
+}
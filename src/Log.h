@@ -0,0 +1,143 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_LOG_H
+#define SEUSS_LOG_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+/** Log.h
+ * Binary log rings for the invoker and controller hot paths. A log call
+ * stores a pointer to its (literal) format string and up to eight integer
+ * arguments in the ring of the calling core (native) or thread (hosted).
+ * Formatting and printing happen later, when the ring is drained. Errors are
+ * the exception: they are printed immediately, so they are not lost if the
+ * error is followed by a kabort.
+ *
+ * Format strings are printf-style, and every argument is passed as a 64-bit
+ * integer, so use %lu, %ld, %lx, ... for all conversions.
+ */
+
+/* Statements above this level never log. They are still compiled (and their
+ * arguments type-checked), the constant condition lets the compiler drop
+ * them */
+#ifndef SEUSS_LOG_MAX_LEVEL
+#define SEUSS_LOG_MAX_LEVEL 3 // debug
+#endif
+
+#define SEUSS_LOG(lvl, fmt, ...)                                               \
+  do {                                                                         \
+    if ((lvl) <= SEUSS_LOG_MAX_LEVEL && (lvl) <= seuss::log::level) {          \
+      seuss::log::Local().Push((lvl), "" fmt, ##__VA_ARGS__);                  \
+    }                                                                          \
+  } while (0)
+
+#define SEUSS_LOG_ERROR(fmt, ...)                                              \
+  seuss::log::Sync(seuss::log::error, "" fmt, ##__VA_ARGS__)
+#define SEUSS_LOG_WARN(fmt, ...) SEUSS_LOG(seuss::log::warn, fmt, ##__VA_ARGS__)
+#define SEUSS_LOG_INFO(fmt, ...) SEUSS_LOG(seuss::log::info, fmt, ##__VA_ARGS__)
+#define SEUSS_LOG_DEBUG(fmt, ...) SEUSS_LOG(seuss::log::debug, fmt, ##__VA_ARGS__)
+
+namespace seuss {
+namespace log {
+
+enum Level : uint8_t { error = 0, warn, info, debug };
+
+/* Records held per ring, a full ring drops new records */
+const uint32_t ring_size = 4096;
+/* How often rings are drained */
+const uint32_t drain_ms = 100;
+const uint8_t max_args = 8;
+
+/* Runtime log level (default warn) */
+extern Level level;
+
+struct Record {
+  uint64_t time_us; // since boot (native) or epoch (hosted)
+  const char *fmt;
+  uint8_t level;
+  uint8_t nargs;
+  uint64_t args[max_args];
+};
+
+/* seuss::log::Ring
+ * Lock-free single-producer/single-consumer ring of log records.
+ */
+class Ring {
+public:
+  template <typename... Args>
+  void Push(uint8_t lvl, const char *fmt, Args... args) {
+    auto head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= ring_size) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    Fill(records_[head % ring_size], lvl, fmt, args...);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  template <typename... Args>
+  static void Fill(Record &r, uint8_t lvl, const char *fmt, Args... args) {
+    static_assert(sizeof...(Args) <= max_args, "too many log arguments");
+    r.time_us = now_us();
+    r.fmt = fmt;
+    r.level = lvl;
+    r.nargs = sizeof...(Args);
+    store_args(r.args, args...);
+  }
+
+  /* Consume the next record, returns false if the ring is empty */
+  bool Pop(Record &r);
+
+  /* Records dropped (full ring) since the last call */
+  uint64_t TakeDropped() {
+    return dropped_.exchange(0, std::memory_order_relaxed);
+  }
+
+private:
+  static uint64_t now_us();
+  static void store_args(uint64_t *) {}
+  template <typename T, typename... Rest>
+  static void store_args(uint64_t *out, T v, Rest... rest) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value ||
+                      std::is_pointer<T>::value,
+                  "log arguments must be integers or pointers");
+    *out = (uint64_t)v;
+    store_args(out + 1, rest...);
+  }
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+  std::array<Record, ring_size> records_;
+}; // end class Ring
+
+/* Ring of the calling core (native) or thread (hosted) */
+Ring &Local();
+
+/* Set the runtime level and start draining the rings. On native this is
+ * called on each core, and drains that core's ring. */
+void Init(Level lvl);
+
+/* Format and print every record in the ring */
+void Drain(Ring &ring);
+
+/* Format and print a record now. On native the local ring is drained first
+ * so the output stays in order. */
+void Write(const Record &r);
+
+template <typename... Args>
+void Sync(uint8_t lvl, const char *fmt, Args... args) {
+  if (lvl > SEUSS_LOG_MAX_LEVEL || lvl > level)
+    return;
+  Record r;
+  Ring::Fill(r, lvl, fmt, args...);
+  Write(r);
+}
+
+} // end namespace log
+} // end namespace seuss
+#endif
@@ -0,0 +1,68 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <ebbrt/Debug.h>
+
+#include "PortAllocator.h"
+
+seuss::PortAllocator::PortAllocator(uint16_t base, uint16_t range, size_t core,
+                                    size_t ncores)
+    : base_(base), core_(core), ncores_(ncores) {
+  kassert(ncores_ > 0);
+  kassert(core_ < range);
+  slots_ = (range - core_ + ncores_ - 1) / ncores_;
+  bitmap_.resize((slots_ + 63) / 64, 0);
+  quarantined_.resize(bitmap_.size(), 0);
+}
+
+uint16_t seuss::PortAllocator::Allocate() {
+  drain_quarantine(ebbrt::clock::Wall::Now());
+  if (in_use_ >= slots_) {
+    if (quarantine_.empty())
+      return 0;
+    // Out of ports, cut the oldest quarantine short
+    drain_quarantine(quarantine_.front().second);
+  }
+  // Next-fit scan starting after the last allocated slot
+  for (size_t n = 0; n < slots_; n++) {
+    auto slot = (cursor_ + n) % slots_;
+    auto &word = bitmap_[slot / 64];
+    uint64_t bit = 1ull << (slot % 64);
+    if (!(word & bit)) {
+      word |= bit;
+      in_use_++;
+      cursor_ = slot + 1;
+      return base_ + core_ + (slot * ncores_);
+    }
+  }
+  return 0;
+}
+
+void seuss::PortAllocator::Release(uint16_t port) {
+  kassert(port >= base_ + core_);
+  size_t offset = port - base_ - core_;
+  kassert(offset % ncores_ == 0);
+  auto slot = offset / ncores_;
+  kassert(slot < slots_);
+  uint64_t bit = 1ull << (slot % 64);
+  kassert(bitmap_[slot / 64] & bit);
+  // Released twice, the second would free the port while it is reused
+  kassert(!(quarantined_[slot / 64] & bit));
+  quarantined_[slot / 64] |= bit;
+  // Stays marked in the bitmap until the quarantine expires
+  quarantine_.push(std::make_pair(
+      slot, ebbrt::clock::Wall::Now() +
+                std::chrono::milliseconds(port_quarantine_ms)));
+}
+
+void seuss::PortAllocator::drain_quarantine(
+    ebbrt::clock::Wall::time_point now) {
+  while (!quarantine_.empty() && quarantine_.front().second <= now) {
+    auto slot = quarantine_.front().first;
+    bitmap_[slot / 64] &= ~(1ull << (slot % 64));
+    quarantined_[slot / 64] &= ~(1ull << (slot % 64));
+    in_use_--;
+    quarantine_.pop();
+  }
+}
@@ -0,0 +1,54 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_PORT_ALLOCATOR_H
+#define SEUSS_PORT_ALLOCATOR_H
+
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+#include <ebbrt/Clock.h>
+
+namespace seuss {
+
+/* Time a released port is held back while its connection sits in TIME_WAIT */
+const uint32_t port_quarantine_ms = 4000;
+
+/* seuss::PortAllocator
+ * Per-core allocator of invocation session source ports. A core owns every
+ * port in [base, base+range) that is congruent to its core index modulo the
+ * core count, so cores never contend. Ports are tracked in a bitmap and stay
+ * reserved from Allocate() until Release(), after which they are quarantined
+ * for port_quarantine_ms before they can be handed out again (or earlier, if
+ * the core runs out of ports).
+ */
+class PortAllocator {
+public:
+  PortAllocator(uint16_t base, uint16_t range, size_t core, size_t ncores);
+
+  /* Reserve a free source port, returns 0 if none is available */
+  uint16_t Allocate();
+
+  /* Return a port once its session is done with it */
+  void Release(uint16_t port);
+
+  /* Number of ports currently reserved or quarantined */
+  size_t InUse() const { return in_use_; }
+
+private:
+  void drain_quarantine(ebbrt::clock::Wall::time_point now);
+  uint16_t base_;
+  size_t core_;
+  size_t ncores_;
+  size_t slots_; // number of ports owned by this core
+  size_t cursor_ = 0;
+  size_t in_use_ = 0;
+  std::vector<uint64_t> bitmap_; // 1 = reserved or quarantined
+  std::vector<uint64_t> quarantined_; // 1 = released, not yet reusable
+  std::queue<std::pair<size_t, ebbrt::clock::Wall::time_point>> quarantine_;
+}; // end class PortAllocator
+
+} // end namespace seuss
+#endif
@@ -7,11 +7,27 @@
 
 namespace seuss {
 
+/** How the instance of an invocation was started (in fallback order) */
+enum class StartType : uint8_t { hot = 0, warm, cold };
+
+/** Time spent in each phase of an invocation on the node (us) */
+struct PhaseTimes {
+  uint32_t queue;    // waiting in the node's work queue
+  uint32_t load;     // loading the instance from snapshot
+  uint32_t start;    // starting (or resuming) the instance
+  uint32_t connect;  // establishing the TCP connection
+  uint32_t init;     // the /init request
+  uint32_t run;      // the /run request
+};
+
 /** Statics for the runtime of a function */
 struct ExecStats {
-  size_t run_time;
-  size_t init_time;
+  size_t run_time;  // ms
+  size_t init_time; // ms, 1 marks a warm start
   bool status; // success=0 failed=1
+  uint16_t concurrency_limit; // invoker core limit when the run finished
+  StartType start_type;
+  PhaseTimes us;
 };
 
 /** Function activation record */
@@ -20,6 +36,7 @@ struct InvocationStats {
   size_t function_id;  
   size_t args_size;
   char activation_id[34] = {0};
+  uint32_t timeout_ms = 0; // action time limit, 0 = invoker default
   ExecStats exec = {0}; // zero fill
 };
 
@@ -27,6 +44,7 @@ struct Invocation {
   InvocationStats info;
   std::string code;
   std::string args;
+  bool prewarm = false; // only /init and capture the snapshot, no /run
 };
 
 } // end seuss
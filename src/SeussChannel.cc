@@ -27,11 +27,11 @@ void seuss::SeussChannel::Ping(ebbrt::Messenger::NetworkId nid){
   SendMessage(nid, std::move(buf));
 };
 
-void seuss::SeussChannel::SendReply(ebbrt::Messenger::NetworkId nid, InvocationStats istats, std::string args) {
+void seuss::SeussChannel::SendReply(ebbrt::Messenger::NetworkId nid, InvocationStats istats, std::string args, MsgType type) {
 #ifdef __ebbrt__ /* Native (EbbRT) */
   if ((size_t)ebbrt::Cpu::GetMine() != io_core) {
-    ebbrt::event_manager->SpawnRemote([=]() { SendReply(nid, istats, args); },
-                                      io_core);
+    ebbrt::event_manager->SpawnRemote(
+        [=]() { SendReply(nid, istats, args, type); }, io_core);
     return;
   }
 #endif
@@ -41,7 +41,7 @@ void seuss::SeussChannel::SendReply(ebbrt::Messenger::NetworkId nid, InvocationS
   auto dp = buf->GetMutDataPointer();
   // Complete the message header
   auto &hdr = dp.Get<MsgHeader>();
-  hdr.type = MsgType::reply;
+  hdr.type = type;
   hdr.record = istats;
   hdr.record.args_size = args.size(); // Is this nescessary? 
   // Copy in msg payload
@@ -53,14 +53,14 @@ void seuss::SeussChannel::SendReply(ebbrt::Messenger::NetworkId nid, InvocationS
   SendMessage(nid, std::move(buf));
 }
 
-void seuss::SeussChannel::SendRequest(ebbrt::Messenger::NetworkId nid, InvocationStats istats, std::string args, std::string code) {
+void seuss::SeussChannel::SendRequest(ebbrt::Messenger::NetworkId nid, InvocationStats istats, std::string args, std::string code, MsgType type) {
   // New IOBuf for the outgoing message
   auto buf =
       MakeUniqueIOBuf(sizeof(MsgHeader) + args.size() + code.size());
   auto dp = buf->GetMutDataPointer();
   // Complete the message header
   auto &hdr = dp.Get<MsgHeader>();
-  hdr.type = MsgType::request;
+  hdr.type = type;
   hdr.record = istats; 
   // Copy in msg payloads
   hdr.len = args.size() + code.size();
@@ -128,7 +128,12 @@ void seuss::SeussChannel::ReceiveMessage(ebbrt::Messenger::NetworkId nid,
     /* Call the invoker to spawn the action */
     seuss::invoker->Queue(i);
     break;
+  case MsgType::prewarm:
+    i.prewarm = true;
+    seuss::invoker->Queue(i);
+    break;
   case MsgType::reply:
+  case MsgType::snapshot_stored:
     kabort("Received invocation reply on EbbRT (native)!?\n");
     break;
 #else /* Hosted (Linux) */
@@ -136,11 +141,15 @@ void seuss::SeussChannel::ReceiveMessage(ebbrt::Messenger::NetworkId nid,
     kprintf_force("SeussChannel - pong!\n");
     break;
   case MsgType::request:
+  case MsgType::prewarm:
     kabort("Received invocation request on Linux !?\n");
     break;
   case MsgType::reply:
     seuss::controller->ResolveActivation(hdr.record, i.args);
     break;
+  case MsgType::snapshot_stored:
+    seuss::controller->AddSnapshotNode(nid, hdr.record.function_id);
+    break;
 #endif
   } // end switch(hdr.type)
 };
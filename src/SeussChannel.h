@@ -24,6 +24,8 @@ enum MsgType : uint8_t {
   ping = 0,
   request,
   reply,
+  prewarm,         // hosted -> native: init a function and snapshot it
+  snapshot_stored, // native -> hosted: the node cached a function snapshot
 };
 
 struct MsgHeader {
@@ -44,10 +46,11 @@ public:
 
   // TODO: Combine SendRequest and SendReply
   void SendRequest(ebbrt::Messenger::NetworkId nid, InvocationStats istats,
-                   std::string code, std::string args);
+                   std::string code, std::string args,
+                   MsgType type = MsgType::request);
 
   void SendReply(ebbrt::Messenger::NetworkId nid, InvocationStats istats,
-                   std::string args);
+                   std::string args, MsgType type = MsgType::reply);
 
   void ReceiveMessage(ebbrt::Messenger::NetworkId nid,
                       std::unique_ptr<ebbrt::IOBuf> &&buf);
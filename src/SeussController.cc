@@ -5,8 +5,10 @@
 #include <iostream>
 #include <sstream> /* std::ostringstream */
 
+#include "Log.h"
 #include "SeussChannel.h"
 #include "SeussController.h"
+#include "Trace.h"
 
 #include <ebbrt/Debug.h>
 #include <ebbrt/Future.h>
@@ -14,6 +16,8 @@
 using namespace std;
 
 void seuss::Init() {
+  seuss::log::Init(
+      static_cast<seuss::log::Level>(ebbrt::dsys::log_level));
   { // Initialize the controller
     auto rep = new Controller(Controller::global_id);
     Controller::Create(rep, Controller::global_id);
@@ -41,6 +45,52 @@ void seuss::Controller::RegisterNode(ebbrt::Messenger::NetworkId nid) {
       [this, nid]() { /*seuss_channel->Ping(nid);*/ }, ctxt);
 }
 
+void seuss::Controller::Prewarm(const openwhisk::msg::ActivationMessage &am,
+                                std::string code) {
+  if (_nids.empty())
+    return;
+  auto fid = function_id(am);
+  auto nid = home_node(fid);
+  InvocationStats stats;
+  {
+    std::lock_guard<std::mutex> guard(m_);
+    // Already has the snapshot
+    auto nodes = snapshot_nodes_.find(fid);
+    if (nodes != snapshot_nodes_.end()) {
+      for (auto &n : nodes->second) {
+        if (n.ToString() == nid.ToString())
+          return;
+      }
+    }
+    // Unique in the node's work queue, there is no activation to reply to
+    stats.transaction_id = std::hash<std::string>{}(
+        "prewarm:" + std::to_string(fid) + ":" +
+        std::to_string(prewarm_ctr_++));
+  }
+  stats.function_id = fid;
+  stats.args_size = 0;
+  stats.timeout_ms = openwhisk::couchdb::get_action_timeout(am.action_);
+  SEUSS_LOG_INFO("Prewarming fid=%lu\n", fid);
+  auto nid_io_cpu = _frontEnd_cpus_map[nid.ToString()];
+  ebbrt::event_manager->SpawnRemote(
+      [nid, stats, code]() {
+        seuss_channel->SendRequest(nid, stats, std::string(), code,
+                                   MsgType::prewarm);
+      },
+      ebbrt::Cpu::GetByIndex(nid_io_cpu)->get_context());
+}
+
+void seuss::Controller::AddSnapshotNode(ebbrt::Messenger::NetworkId nid,
+                                        size_t fid) {
+  std::lock_guard<std::mutex> guard(m_);
+  auto &nodes = snapshot_nodes_[fid];
+  for (auto &n : nodes) {
+    if (n.ToString() == nid.ToString())
+      return;
+  }
+  nodes.push_back(nid);
+}
+
 bool seuss::Controller::Ready(){
   return !_nids.empty(); // verify we have a backend node
 }
@@ -50,18 +100,22 @@ seuss::Controller::ScheduleActivation(
     const openwhisk::msg::ActivationMessage &am, std::string code ) {
 
   auto start = std::chrono::high_resolution_clock::now();
+  auto trace_start = seuss::trace::Now();
+  uint64_t tid = seuss::trace::TransactionId(am.transid_.name_); // OpenWhisk transaction id (unique)
 
-  if(code.empty())
+  if(code.empty()){
     code = openwhisk::couchdb::get_action(am.action_);
+    seuss::trace::Span(tid, "couchdb.fetch", trace_start, seuss::trace::Now());
+  }
 
-  uint64_t tid = std::hash<std::string>{}(am.transid_.name_); // OpenWhisk transaction id (unique)
-  size_t fid = std::hash<std::string>{}(am.revision_);
+  size_t fid = function_id(am);
 
   auto args = am.content_;
   InvocationStats stats;
   stats.transaction_id = tid;
   stats.function_id = fid;
   stats.args_size = args.size();
+  stats.timeout_ms = openwhisk::couchdb::get_action_timeout(am.action_);
   std::copy(am.activationId_.begin(), am.activationId_.begin()+33, stats.activation_id);
 
   //std::cout << "CONTROLLER: scheduling activation on core #"
@@ -82,12 +136,12 @@ seuss::Controller::ScheduleActivation(
     std::lock_guard<std::mutex> guard(m_);
     bool inserted;
     // insert records into the hash tables
-    std::cout << "Scheduling activation tid=" << tid << std::endl;
+    SEUSS_LOG_DEBUG("Scheduling activation tid=%lu\n", tid);
     std::tie(std::ignore, inserted) =
         record_map_.emplace(tid, std::move(record));
     // Assert there was no collision on the key
     if (!inserted) {
-      std::cout << "WARNING: duplicated activation tid=" << tid << std::endl;
+      SEUSS_LOG_WARN("duplicated activation tid=%lu\n", tid);
       assert(inserted);
     }
   }
@@ -100,12 +154,14 @@ seuss::Controller::ScheduleActivation(
 
   /* Send the event via IO thread for this backend node */
   auto nid_io_cpu = _frontEnd_cpus_map[nid.ToString()];
+  auto scheduled = seuss::trace::Now();
+  seuss::trace::Span(tid, "controller.schedule", trace_start, scheduled);
   ebbrt::event_manager->SpawnRemote(
-      [this, nid, stats, code, args]() {
+      [this, nid, stats, code, args, tid, scheduled]() {
         seuss_channel->SendRequest(nid, stats, args, code);
+        seuss::trace::Span(tid, "channel.send", scheduled, seuss::trace::Now());
       },
       ebbrt::Cpu::GetByIndex(nid_io_cpu)->get_context());
-
   return ret;
 }
 
@@ -113,12 +169,14 @@ void seuss::Controller::ResolveActivation(seuss::InvocationStats istats, std::st
   std::ostringstream annotations;
   // Capture the ending time
   auto end_time = std::chrono::high_resolution_clock::now();
+  auto reply_time = seuss::trace::Now();
+  seuss::trace::NodeSpans(istats, reply_time);
   // Lookup activation in the table
   uint64_t tid = istats.transaction_id;
   std::lock_guard<std::mutex> guard(m_);
   auto it = record_map_.find(tid);
   if(it == record_map_.end()){
-    cout << "ERROR: NO RECORD FOUND FOR tid=" << tid << endl;
+    SEUSS_LOG_ERROR("NO RECORD FOUND FOR tid=%lu\n", tid);
     return;
   }
   auto record_tuple = std::move(it->second);
@@ -131,6 +189,17 @@ void seuss::Controller::ResolveActivation(seuss::InvocationStats istats, std::st
   auto wait_time = total_time - istats.exec.run_time - istats.exec.init_time;
   // annotations (waitTime, initTime)
   annotations << R"({"key":"waitTime","value":)" << wait_time << R"(},{"key":"initTime","value":)"<< istats.exec.init_time << R"(})";
+  annotations << R"(,{"key":"concurrencyLimit","value":)" << istats.exec.concurrency_limit << R"(})";
+  // where the time went on the node (us)
+  static const char *start_types[] = {"hot", "warm", "cold"};
+  auto &us = istats.exec.us;
+  annotations << R"(,{"key":"startType","value":")"
+              << start_types[(uint8_t)istats.exec.start_type % 3] << R"("})";
+  annotations << R"(,{"key":"phaseTimes","value":{)"
+              << R"("queue":)" << us.queue << R"(,"load":)" << us.load
+              << R"(,"start":)" << us.start << R"(,"connect":)" << us.connect
+              << R"(,"init":)" << us.init << R"(,"run":)" << us.run
+              << R"(}})";
   cm.response_.annotations_ = annotations.str();
   cm.response_.duration_ = istats.exec.run_time;
   cm.response_.start_ = 0;
@@ -139,4 +208,5 @@ void seuss::Controller::ResolveActivation(seuss::InvocationStats istats, std::st
   cm.response_.result_ = res;
   std::get<0>(record_tuple).SetValue(cm);
   record_map_.erase(it);
+  seuss::trace::Span(tid, "controller.reply", reply_time, seuss::trace::Now());
 }
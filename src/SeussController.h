@@ -54,6 +54,14 @@ public:
   // Register an Invocation node
   void RegisterNode(ebbrt::Messenger::NetworkId nid);
 
+  // Record that a node holds the snapshot of a function
+  void AddSnapshotNode(ebbrt::Messenger::NetworkId nid, size_t fid);
+
+  /* Have the function's home node run /init and capture its snapshot
+   * ahead of its activations. The caller has the code (e.g., the action was
+   * just created or updated), the event loop never fetches it */
+  void Prewarm(const openwhisk::msg::ActivationMessage &am, std::string code);
+
 private:
   typedef std::tuple<ebbrt::Promise<openwhisk::msg::CompletionMessage>,
                     openwhisk::msg::ActivationMessage,std::chrono::high_resolution_clock::time_point>
@@ -63,6 +71,15 @@ private:
       _frontEnd_cpus_map; // maps str(ip) to cpu index
   std::mutex m_;
   std::unordered_map<uint64_t, activation_record> record_map_;
+  // Nodes holding a snapshot of each function
+  std::unordered_map<size_t, std::vector<ebbrt::Messenger::NetworkId>>
+      snapshot_nodes_;
+  uint64_t prewarm_ctr_ = 0;
+  size_t function_id(const openwhisk::msg::ActivationMessage &am) {
+    return std::hash<std::string>{}(am.revision_);
+  }
+  // XXX: Every function runs on the first node (SINGLE BACKEND)
+  ebbrt::Messenger::NetworkId home_node(size_t fid) { return _nids.front(); }
 };
 
 constexpr auto controller = ebbrt::EbbRef<Controller>(Controller::global_id);
@@ -3,7 +3,8 @@
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
 
-#include <algorithm> /* std::remove */
+#include <algorithm> /* std::remove, std::partial_sort */
+#include <functional> /* std::greater */
 #include <sstream> /* std::ostringstream */
 
 #include <ebbrt/Debug.h>
@@ -18,6 +19,7 @@
 #include "SeussChannel.h"
 
 #include "InvocationSession.h"
+#include "Log.h"
 #include "umm/src/UmManager.h"
 
 #define DEBUG_PRINT_SEUSS 0
@@ -32,63 +34,220 @@ void seuss::Init(){
   auto invoker_root = new InvokerRoot();
   invoker_root->ebb_ = Invoker::Create(invoker_root, Invoker::global_id);
 
-	// Init invoker on each core
+  invoker_root->StartupMark("init");
+
+  // Init invoker on each core, the other cores initialize while this one
+  // builds the base snapshot
   size_t num_cpus = ebbrt::Cpu::Count();
+  size_t mine = ebbrt::Cpu::GetMine();
+  std::vector<ebbrt::Promise<void>> online(num_cpus);
+  std::vector<ebbrt::Future<void>> online_f;
   for (size_t i = 0; i < num_cpus; i++) {
-    ebbrt::Promise<void> p; 
-    auto f = p.GetFuture();
+    if (i == mine)
+      continue;
+    online_f.push_back(online[i].GetFuture());
+    auto p = &online[i];
     ebbrt::event_manager->SpawnRemote(
-        [&p]() {
+        [p]() {
           seuss::invoker->Init();
-          p.SetValue();
+          p->SetValue();
         },
         i);
+  }
+  seuss::invoker->Init();
+  invoker_root->BuildBaseSnapshot();
+  invoker_root->StartupMark("base snapshot");
+  for (auto &f : online_f) {
     f.Block();
   }
+  invoker_root->StartupMark("cores online");
 
   invoker_root->Bootstrap();
+  invoker_root->StartupMark("bootstrap");
+
+  // Start staging instances on every core
+  for (size_t i = 0; i < num_cpus; i++) {
+    ebbrt::event_manager->SpawnRemote([]() { seuss::invoker->Poke(); }, i);
+  }
   kprintf_force(GREEN "\nFinished initialization of Seuss Invoker(())\n" RESET);
 }
 
+namespace {
+/* Session handler of the warmup function run during bootstrap */
+class BootstrapHandler : public seuss::InvocationSession::Handler {
+public:
+  void SessionConnected(seuss::InvocationSession *umsesh) override {
+    /* Initialize the code and keep the connection alive */
+    umsesh->SendHttpRequest("/preInit", true /* keep_alive */);
+  }
+  void SessionInitialized(seuss::InvocationSession *umsesh) override {
+    umsesh->SendHttpRequest("/preRun", false /* keep_alive */);
+  }
+  void SessionExecuted(seuss::InvocationSession *umsesh) override {
+    // we're happy
+  }
+  void SessionClosed(seuss::InvocationSession *umsesh) override {
+    /* Return to InvokerRoot::Bootstrap once the connection has closed */
+    if (done_)
+      return;
+    done_ = true;
+    ebbrt::event_manager->SpawnLocal([] { umm::manager->Halt(); },
+                                     /* async */ true);
+  }
+  void SessionAborted(seuss::InvocationSession *umsesh) override {
+    if (done_)
+      return;
+    ebbrt::kabort("Bootstrap process failed to pre-init\n");
+  }
+
+private:
+  bool done_ = false;
+} bootstrap_handler;
+} // end local namespace
+
 /* class seuss::InvokerRoot */
+void seuss::InvokerRoot::RegisterCore(size_t core, size_t node) {
+  kassert(node < max_numa_nodes);
+  // Cores register concurrently, from any node
+  std::lock_guard<ebbrt::SpinLock> guard(register_lock_);
+  {
+    std::lock_guard<ebbrt::SpinLock> qguard(shards_[node].qlock);
+    shards_[node].cores.push_back(core);
+  }
+  if (node + 1 > num_nodes_)
+    num_nodes_ = node + 1;
+}
+
+void seuss::InvokerRoot::StartupMark(const char *event) {
+  // The native wall clock counts from boot
+  auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                ebbrt::clock::Wall::Now().time_since_epoch())
+                .count();
+  kprintf_force("Startup timeline: %s at %llu ms\n", event,
+                (unsigned long long)ms);
+}
+
+void seuss::InvokerRoot::FirstInvocation() {
+  if (first_invocation_.exchange(true))
+    return;
+  StartupMark("first invocation");
+}
+
+seuss::InvokerRoot::NodeShard &seuss::InvokerRoot::local_shard() {
+  return shards_[ebbrt::Cpu::GetMyNode().val()];
+}
+
 size_t seuss::InvokerRoot::AddWork(seuss::Invocation i) {
-  std::lock_guard<ebbrt::SpinLock> guard(qlock_);
-  Invocation record = i; 
   auto tid = i.info.transaction_id;
-  // insert records into the hash tables
-  bool inserted;
-  std::tie(std::ignore, inserted) =
-      request_map_.emplace(tid, std::move(record));
-  // Assert there was no collision on the key
-  kassert(inserted);
-  request_queue_.push(tid);
+  auto fid = i.info.function_id;
+  if (!i.prewarm) {
+    {
+      std::lock_guard<ebbrt::SpinLock> arrival_guard(arrival_lock_);
+      arrival_map_[fid].Record(ebbrt::clock::Wall::Now());
+    }
+    // A core loaded an instance for this arrival, run it there
+    size_t core;
+    if (claim_prewarmed_core(fid, core)) {
+      ebbrt::event_manager->SpawnRemote(
+          [i]() { seuss::invoker->QueueLocal(i); }, core);
+      return 0;
+    }
+  }
 
-  // Inform all the cores about the work starting at a random offset
-  size_t num_cpus = ebbrt::Cpu::Count();
-  size_t offset = tid % num_cpus;
-  for (size_t i = 0; i < num_cpus; i++) {
-    auto core = (i + offset) % num_cpus;
-    if (core != ebbrt::Cpu::GetMine()) {
+  // Spread the work across the nodes, scanning from the round-robin index
+  size_t nodes = num_nodes_.load();
+  size_t start = next_node_.fetch_add(1, std::memory_order_relaxed);
+  size_t node = nodes;
+  for (size_t n = 0; node == nodes && n < nodes; n++) {
+    auto candidate = (start + n) % nodes;
+    if (node_has_cores(candidate))
+      node = candidate;
+  }
+  kassert(node < nodes);
+
+  auto &shard = shards_[node];
+  std::vector<size_t> node_cores;
+  bool backlogged;
+  {
+    std::lock_guard<ebbrt::SpinLock> guard(shard.qlock);
+    // insert records into the hash tables
+    bool inserted;
+    std::tie(std::ignore, inserted) = shard.request_map.emplace(tid, i);
+    // Assert there was no collision on the key
+    kassert(inserted);
+    shard.request_queue.push(std::make_pair(tid, ebbrt::clock::Wall::Now()));
+    node_cores = shard.cores;
+    // More work waiting than the node has cores to pick it up
+    backlogged = shard.request_queue.size() > node_cores.size();
+  }
+
+  // Inform the node's cores about the work starting at a random offset
+  size_t mine = ebbrt::Cpu::GetMine();
+  size_t offset = tid % node_cores.size();
+  for (size_t n = 0; n < node_cores.size(); n++) {
+    auto core = node_cores[(n + offset) % node_cores.size()];
+    if (core != mine)
       ebbrt::event_manager->SpawnRemote([this]() { ebb_->Poke(); }, core);
+  }
+  // The cores of other nodes only steal the backlog
+  if (backlogged) {
+    for (size_t n = 0; n < nodes; n++) {
+      if (n == node)
+        continue;
+      std::vector<size_t> cores;
+      {
+        std::lock_guard<ebbrt::SpinLock> guard(shards_[n].qlock);
+        cores = shards_[n].cores;
+      }
+      for (auto core : cores) {
+        if (core != mine)
+          ebbrt::event_manager->SpawnRemote([this]() { ebb_->Poke(); }, core);
+      }
     }
   }
   return 0;
 }
 
-bool seuss::InvokerRoot::GetWork(Invocation& i) {
-  std::lock_guard<ebbrt::SpinLock> guard(qlock_);
-  if (request_queue_.empty())
+bool seuss::InvokerRoot::node_has_cores(size_t node) {
+  std::lock_guard<ebbrt::SpinLock> guard(shards_[node].qlock);
+  return !shards_[node].cores.empty();
+}
+
+bool seuss::InvokerRoot::take_work(NodeShard &shard, Invocation &i,
+                                   uint64_t &queue_us) {
+  std::lock_guard<ebbrt::SpinLock> guard(shard.qlock);
+  if (shard.request_queue.empty())
     return false;
-  uint64_t tid = request_queue_.front();
-  request_queue_.pop();
-  auto req = request_map_.find(tid);
+  uint64_t tid = shard.request_queue.front().first;
+  queue_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                 ebbrt::clock::Wall::Now() - shard.request_queue.front().second)
+                 .count();
+  shard.request_queue.pop();
+  auto req = shard.request_map.find(tid);
   // TODO: fail gracefully, drop request
-  kassert(req != request_map_.end());
+  kassert(req != shard.request_map.end());
   i = req->second;
-  request_map_.erase(tid);
+  shard.request_map.erase(req);
   return true;
 }
 
+bool seuss::InvokerRoot::GetWork(Invocation& i, uint64_t &queue_us) {
+  // Local work first, then steal from the other nodes
+  size_t mine = ebbrt::Cpu::GetMyNode().val();
+  size_t nodes = num_nodes_.load();
+  for (size_t n = 0; n < nodes; n++) {
+    if (take_work(shards_[(mine + n) % nodes], i, queue_us))
+      return true;
+  }
+  return false;
+}
+
+bool seuss::InvokerRoot::HasWork() {
+  auto &shard = local_shard();
+  std::lock_guard<ebbrt::SpinLock> guard(shard.qlock);
+  return !shard.request_queue.empty();
+}
+
 umm::UmSV* seuss::InvokerRoot::GetBaseSV() {
   kassert(is_bootstrapped_);
   return base_um_env_;
@@ -96,7 +255,7 @@ umm::UmSV* seuss::InvokerRoot::GetBaseSV() {
 
 umm::UmSV* seuss::InvokerRoot::GetSnapshot(size_t fid) {
   kassert(is_bootstrapped_);
-  std::lock_guard<ebbrt::SpinLock> guard(qlock_);
+  std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
   auto cache_result = snapmap_.find(fid);
   if(cache_result == snapmap_.end()){
     return nullptr;
@@ -104,41 +263,158 @@ umm::UmSV* seuss::InvokerRoot::GetSnapshot(size_t fid) {
   return cache_result->second;
 }
 
+seuss::KeepAliveWindow seuss::InvokerRoot::GetKeepAliveWindow(size_t fid) {
+  std::lock_guard<ebbrt::SpinLock> guard(arrival_lock_);
+  return arrival_map_[fid].Window();
+}
+
+void seuss::InvokerRoot::SchedulePrewarm(
+    size_t fid, ebbrt::clock::Wall::time_point load,
+    ebbrt::clock::Wall::time_point expires) {
+  std::lock_guard<ebbrt::SpinLock> guard(prewarm_lock_);
+  auto it = prewarm_by_fid_.find(fid);
+  if (it != prewarm_by_fid_.end()) {
+    prewarm_due_.erase(it->second);
+    prewarm_by_fid_.erase(it);
+  }
+  prewarm_by_fid_.emplace(
+      fid, prewarm_due_.emplace(load, std::make_pair(fid, expires)));
+}
+
+bool seuss::InvokerRoot::TakeDuePrewarm(
+    ebbrt::clock::Wall::time_point now, size_t &fid,
+    ebbrt::clock::Wall::time_point &expires) {
+  std::lock_guard<ebbrt::SpinLock> guard(prewarm_lock_);
+  while (!prewarm_due_.empty() && prewarm_due_.begin()->first <= now) {
+    auto entry = prewarm_due_.begin()->second;
+    prewarm_by_fid_.erase(entry.first);
+    prewarm_due_.erase(prewarm_due_.begin());
+    // Skip the pre-warms whose window has already passed
+    if (now < entry.second) {
+      fid = entry.first;
+      expires = entry.second;
+      return true;
+    }
+  }
+  return false;
+}
+
+void seuss::InvokerRoot::SetPrewarmedCore(size_t fid, size_t core) {
+  std::lock_guard<ebbrt::SpinLock> guard(prewarm_lock_);
+  prewarmed_core_[fid] = core;
+}
+
+void seuss::InvokerRoot::ClearPrewarmedCore(size_t fid, size_t core) {
+  std::lock_guard<ebbrt::SpinLock> guard(prewarm_lock_);
+  auto it = prewarmed_core_.find(fid);
+  if (it != prewarmed_core_.end() && it->second == core)
+    prewarmed_core_.erase(it);
+}
+
+bool seuss::InvokerRoot::claim_prewarmed_core(size_t fid, size_t &core) {
+  std::lock_guard<ebbrt::SpinLock> guard(prewarm_lock_);
+  auto it = prewarmed_core_.find(fid);
+  if (it == prewarmed_core_.end())
+    return false;
+  core = it->second;
+  prewarmed_core_.erase(it);
+  return true;
+}
+
 bool seuss::InvokerRoot::SetSnapshot(size_t fid, umm::UmSV* sv) {
   kassert(is_bootstrapped_);
-  auto cache_result = snapmap_.find(fid);
-  if (cache_result != snapmap_.end()) {
-    /* CACHE HIT */
-    kprintf(RED "Wasted Snapshot for fid #%u\n" RESET, fid);
-    delete sv;
+  // Save the snapshot into the snapmap
+  {
+    std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+    auto cache_result = snapmap_.find(fid);
+    if (cache_result != snapmap_.end()) {
+      /* CACHE HIT */
+      kprintf(RED "Wasted Snapshot for fid #%u\n" RESET, fid);
+      delete sv;
+      return false;
+    }
+    // Do we have room for another snapshot?
+    if (CacheIsFull()) {
+      // Here is where we could evict a snapshot
+      kprintf_force(YELLOW "Cache full! No room for snapshot #%u\n" RESET, fid);
+      delete sv;
+      return false;
+    }
+    snapmap_.emplace(fid, sv);
+    kprintf(YELLOW "Snapshot created for fid #%u\n" RESET, fid);
+  }
+  return true;
+}
+
+bool seuss::InvokerRoot::ClaimWarmSnapshot(size_t fid) {
+  std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+  // Only functions with a snapshot are re-snapshotted, and only once
+  if (snapmap_.find(fid) == snapmap_.end())
     return false;
+  bool inserted;
+  std::tie(std::ignore, inserted) = warm_snapshots_.insert(fid);
+  return inserted;
+}
+
+void seuss::InvokerRoot::ReleaseWarmSnapshot(size_t fid) {
+  std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+  warm_snapshots_.erase(fid);
+}
+
+void seuss::InvokerRoot::RetainSnapshot(umm::UmSV *sv) {
+  std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+  snapshot_refs_[sv]++;
+}
+
+void seuss::InvokerRoot::ReleaseSnapshot(umm::UmSV *sv) {
+  std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+  auto it = snapshot_refs_.find(sv);
+  kassert(it != snapshot_refs_.end());
+  if (--it->second == 0)
+    snapshot_refs_.erase(it);
+}
+
+void seuss::InvokerRoot::FreeRetiredSnapshots(
+    ebbrt::clock::Wall::time_point now) {
+  std::vector<umm::UmSV *> unused;
+  {
+    std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+    for (auto it = retired_snapshots_.begin();
+         it != retired_snapshots_.end();) {
+      // Wait out a reap interval, a lookup may be about to take a reference
+      if (now - it->second >= std::chrono::milliseconds(keep_alive_reap_ms) &&
+          snapshot_refs_.find(it->first) == snapshot_refs_.end()) {
+        unused.push_back(it->first);
+        it = retired_snapshots_.erase(it);
+      } else {
+        ++it;
+      }
+    }
   }
-  // Do we have room for another snapshot?
-  if (CacheIsFull()) {
-    // Here is where we could evict a snapshot
-    kprintf_force(YELLOW "Cache full! No room for snapshot #%u\n" RESET, fid);
+  for (auto sv : unused) {
     delete sv;
-    return false;
   }
-  // Save the snapshot into the snapmap
-  { 
-    //TODO: lock?
-    bool inserted;
-    std::tie(std::ignore, inserted) =
-        snapmap_.emplace(fid, sv);
-    // Assert there was no collision on the key
-    kassert(inserted);
-    kprintf(YELLOW "Snapshot created for fid #%u\n" RESET, fid);
+}
+
+bool seuss::InvokerRoot::ReplaceSnapshot(size_t fid, umm::UmSV *sv) {
+  kassert(is_bootstrapped_);
+  {
+    std::lock_guard<ebbrt::SpinLock> guard(snaplock_);
+    auto it = snapmap_.find(fid);
+    if (it == snapmap_.end()) {
+      warm_snapshots_.erase(fid);
+      delete sv;
+      return false;
+    }
+    retired_snapshots_.emplace_back(it->second, ebbrt::clock::Wall::Now());
+    it->second = sv;
   }
+  kprintf(YELLOW "Warmed-up snapshot swapped in for fid #%u\n" RESET, fid);
   return true;
 }
 
-void seuss::InvokerRoot::Bootstrap() {
-  // THIS SHOULD RUN AT MOST ONCE
-  kassert(!is_bootstrapped_);
-  kprintf("Bootstrapping InvokerRoot on core #%d nid #%d\n",
-          (size_t)ebbrt::Cpu::GetMine(), ebbrt::Cpu::GetMyNode().val());
-
+void seuss::InvokerRoot::BuildBaseSnapshot() {
+  kassert(!base_um_env_);
   { // Preinit Snapshot
     auto sv = umm::ElfLoader::createSVFromElf(&_sv_start);
     auto umi = std::make_unique<umm::UmInstance>(sv);
@@ -193,37 +469,10 @@ function main(args) {
     std::string args = R"({"spin":"0"})";
 
     // new invocation session for warmup code
-    auto pcb = new ebbrt::NetworkManager::TcpPcb;
-    auto umsesh = new InvocationSession(std::move(*pcb), 49159);
-    umsesh->WhenConnected().Then([umsesh, code](auto f) {
-      /* If we have code, initialize it and keep the connection alive */
-      umsesh->SendHttpRequest("/preInit", code, true /* keep_alive */);
-    });
-
-    /* When initialized send the run request */
-    umsesh->WhenInitialized().Then([umsesh, args](auto f) {
-      // Record initialization time, send run operation
-      umsesh->SendHttpRequest("/preRun", args, false /* keep_alive */);
-    });
-
-    /* Resolved invocation after successful execution successfully */
-    umsesh->WhenExecuted().Then([](auto f) {
-      // we're happy
-    });
-
-    /* Finalize this invocation when connection has closed */
-    umsesh->WhenClosed().Then([this](auto f) {
-      ebbrt::event_manager->SpawnLocal(
-          [] {
-            umm::manager->Halt();
-          },
-          /* async */ true);
-    });
-
-    /* Something went wrong. Kill the instance */
-    umsesh->WhenAborted().Then([this](auto f) {
-      ebbrt::kabort("Bootstrap process failed to pre-init\n");
-    });
+    auto umsesh =
+        new InvocationSession(ebbrt::NetworkManager::TcpPcb(), 49159);
+    umsesh->SetPayload(std::move(args), std::move(code));
+    umsesh->SetHandler(&bootstrap_handler);
 
     /* Spawn a new event to make a connection with the instance */
     ebbrt::event_manager->SpawnLocal(
@@ -238,6 +487,14 @@ function main(args) {
     umm::manager->Run(std::move(umi));
     // Block flow control until run has finished
   }
+}
+
+void seuss::InvokerRoot::Bootstrap() {
+  // THIS SHOULD RUN AT MOST ONCE
+  kassert(!is_bootstrapped_);
+  kassert(base_um_env_);
+  kprintf("Bootstrapping InvokerRoot on core #%d nid #%d\n",
+          (size_t)ebbrt::Cpu::GetMine(), ebbrt::Cpu::GetMyNode().val());
 
   is_bootstrapped_ = true;
   return;
@@ -251,10 +508,23 @@ void seuss::Invoker::Init() {
   // Pre-allocate event stacks
   ebbrt::event_manager->PreAllocateStacks(256);
 
+  root_.RegisterCore(core_, ebbrt::Cpu::GetMyNode().val());
+
+  // Pre-allocate invocation sessions
+  session_pool_.reserve(default_session_pool_size);
+  for (size_t i = 0; i < default_session_pool_size; i++) {
+    session_pool_.push_back(
+        new InvocationSession(ebbrt::NetworkManager::TcpPcb(), 0));
+  }
+  pcb_pool_.reserve(default_session_pool_size);
+  refill_pcb_pool();
+
   // args from the multiboot command line
   auto cl = std::string(ebbrt::multiboot::CmdLine());
 
-  // invoker core concurrency_limit
+  // invoker core concurrency_limit (initial value and upper bound)
+  uint16_t clim = default_concurrency_limit;
+  uint16_t cmax = default_concurrency_max;
   {
     auto zkstr = std::string("Clim=");
     auto loc = cl.find(zkstr);
@@ -264,9 +534,40 @@ void seuss::Invoker::Init() {
       if (gap != std::string::npos) {
         clim_str = clim_str.substr(0, gap);
       }
-      request_concurrency_limit_ = atoi(clim_str.c_str());
+      clim = atoi(clim_str.c_str());
+    }
+  }
+  {
+    auto zkstr = std::string("Cmax=");
+    auto loc = cl.find(zkstr);
+    if (loc != std::string::npos) {
+      auto cmax_str = cl.substr((loc + zkstr.size()));
+      auto gap = cmax_str.find(";");
+      if (gap != std::string::npos) {
+        cmax_str = cmax_str.substr(0, gap);
+      }
+      cmax = atoi(cmax_str.c_str());
+    }
+  }
+  // runtime log level
+  {
+    auto lvl = seuss::log::warn;
+    auto zkstr = std::string("Log=");
+    auto loc = cl.find(zkstr);
+    if (loc != std::string::npos) {
+      auto log_str = cl.substr((loc + zkstr.size()));
+      auto gap = log_str.find(";");
+      if (gap != std::string::npos) {
+        log_str = log_str.substr(0, gap);
+      }
+      lvl = static_cast<seuss::log::Level>(atoi(log_str.c_str()));
     }
+    seuss::log::Init(lvl);
   }
+  // never adapt below the requested starting point
+  if (cmax < clim)
+    cmax = clim;
+  concurrency_.Configure(clim, cmax);
   // invoker core spicy start limit
   {
     auto zkstr = std::string("Slim=");
@@ -278,6 +579,17 @@ void seuss::Invoker::Init() {
         clim_str = clim_str.substr(0, gap);
       }
       hot_instance_limit_ = atoi(clim_str.c_str());
+      // check for the JIT warm-up re-snapshot
+      zkstr = std::string("Jlim=");
+      loc = cl.find(zkstr);
+      if (loc != std::string::npos) {
+        auto jlim_str = cl.substr((loc + zkstr.size()));
+        auto gap = jlim_str.find(";");
+        if (gap != std::string::npos) {
+          jlim_str = jlim_str.substr(0, gap);
+        }
+        jit_warmup_runs_ = atoi(jlim_str.c_str());
+      }
       // check for reuse
       zkstr = std::string("Rlim=");
       loc = cl.find(zkstr);
@@ -291,13 +603,21 @@ void seuss::Invoker::Init() {
       }
     }
   }
+  // Start the per-core timer. Besides the keep-alive reaping it expires
+  // staged instances and snapshot deadlines, so it runs even without hot
+  // instances
+  ebbrt::timer->Start(*this, std::chrono::milliseconds(keep_alive_reap_ms),
+                      /* repeat = */ true);
   kprintf("invoker_core_%d is online\n", core_);
   if ((size_t)ebbrt::Cpu::GetMine() == 0) {
-    kprintf_force("invoker_core instance concurrency limit: %d\n",
-                  request_concurrency_limit_);
+    kprintf_force("invoker_core instance concurrency limit: %d (max %d)\n",
+                  clim, cmax);
     kprintf_force(
         "invoker_core instance reuse limits: %d idle / %d reuses\n",
         hot_instance_limit_, hot_instance_reuse_limit_);
+    if (jit_warmup_runs_)
+      kprintf_force("invoker_core re-snapshot after %d warm-up runs\n",
+                    jit_warmup_runs_);
   }
 }
 
@@ -306,15 +626,34 @@ void seuss::Invoker::Queue(seuss::Invocation i) {
   return;
 }
 
+void seuss::Invoker::QueueLocal(seuss::Invocation i) {
+  local_work_.push(std::make_pair(std::move(i), ebbrt::clock::Wall::Now()));
+  Poke();
+}
+
 // Poke() is the stupid/arbitrary way we schedule functions deployments
 void seuss::Invoker::Poke(){
   Invocation i;
-  // Proceed only if we have capacity on this core to do so
-  if (request_concurrency_ >= request_concurrency_limit_) {
-    return;
-  }
-  if (root_.GetWork(i)) {
-    Invoke(i);
+  uint64_t queue_us;
+  // Proceed only while we have capacity on this core to do so
+  while (request_concurrency_ < concurrency_.Limit()) {
+    if (!local_work_.empty()) {
+      i = std::move(local_work_.front().first);
+      queue_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                     ebbrt::clock::Wall::Now() - local_work_.front().second)
+                     .count();
+      local_work_.pop();
+    } else if (!root_.GetWork(i, queue_us)) {
+      // Idle, top up the staged instances in the background
+      if (!staging_) {
+        ebbrt::event_manager->SpawnLocal(
+            []() { seuss::invoker->refill_staged_instances(); }, true);
+      }
+      return;
+    }
+    concurrency_.ObserveQueueDelay(queue_us);
+    i.info.exec.us.queue = queue_us;
+    Invoke(std::move(i));
   }
 }
 
@@ -323,35 +662,181 @@ void seuss::Invoker::Invoke(seuss::Invocation i) {
   ++request_concurrency_;
   ++invctr_;
 
-  if (process_hot_start(i)) {
-    //break;
-  } else if (process_warm_start(i)) {
-    //break;
-  } else if (process_cold_start(i)) {
-    //break;
-  }else{
-    // All attempts failed :(
-    kprintf_force(RED "ERROR: Unable to process invocation\n" RESET);
-    ebbrt::kabort();
+  if (i.prewarm) {
+    auto fid = i.info.function_id;
+    process_prewarm(std::move(i)).Then([this, fid](ebbrt::Future<bool> f) {
+      if (!f.Get())
+        SEUSS_LOG_INFO("C(%lu) prewarm of %lu stored no snapshot\n", core_,
+                       fid);
+      finish_invocation();
+    });
+    return;
   }
+  root_.FirstInvocation();
+  record_function_hit(i.info.function_id);
 
+  // Invoke() returns right away; the invocation continues as events
+  start_invocation(std::move(i), StartType::hot);
+}
+
+void seuss::Invoker::start_invocation(seuss::Invocation i, StartType type) {
+  // The invocation is kept for a fallback, each attempt copies the payload
+  // into its session (once it has one)
+  auto attempt = process_start(i, type);
+  attempt.Then([this, i = std::move(i), type](ebbrt::Future<bool> f) mutable {
+    if (f.Get()) {
+      finish_invocation();
+      return;
+    }
+    if (type == StartType::cold) {
+      // All attempts failed :(
+      kprintf_force(RED "ERROR: Unable to process invocation\n" RESET);
+      ebbrt::kabort();
+    }
+    // Fall back to the next start type (hot -> warm -> cold)
+    start_invocation(std::move(i),
+                     static_cast<StartType>(static_cast<uint8_t>(type) + 1));
+  });
+}
+
+void seuss::Invoker::finish_invocation() {
   --request_concurrency_;
   ebbrt::event_manager->SpawnLocal([]() { seuss::invoker->Poke(); }, true);
 }
 
+ebbrt::Future<bool>
+seuss::Invoker::process_start(const seuss::Invocation &i, StartType type) {
+  switch (type) {
+  case StartType::hot:
+    return process_hot_start(i);
+  case StartType::warm:
+    return process_warm_start(i);
+  default:
+    return process_cold_start(i);
+  }
+}
+
+void seuss::Invoker::start_instance(InvocationSession *umsesh,
+                                    umm::umi::id umi_id) {
+  umsesh->SetPhase(InvocationSession::Phase::start);
+  /* Start run of the instance */
+  ebbrt::event_manager->SpawnLocal([umi_id]() { umm::manager->Start(umi_id); });
+  /* Spawn a new event to make a connection with the instance */
+  ebbrt::event_manager->SpawnLocal([umsesh] { umsesh->Connect(); },
+                                   /* async */ true);
+}
+
+ebbrt::Future<bool>
+seuss::Invoker::when_session_finished(InvocationSession *umsesh) {
+  return umsesh->WhenFinished().Then([umsesh](auto f) {
+    auto status = f.Get();
+    // Parked sessions live on with their hot instance
+    if (!umsesh->IsParked()) {
+      // Don't recycle the session from within its own callback
+      ebbrt::event_manager->SpawnLocal(
+          [umsesh] { seuss::invoker->recycle_session(umsesh); }, true);
+    }
+    return status;
+  });
+}
+
+void seuss::Invoker::Fire() {
+  auto now = ebbrt::clock::Wall::Now();
+  // Reap idle instances whose keep-alive window has expired
+  while (!stalled_expiry_.empty() && stalled_expiry_.begin()->first <= now) {
+    release_hot_instance(stalled_expiry_.begin()->second);
+  }
+  // Pre-warm instances of functions that are expected to arrive soon, the
+  // cores share the schedule and each takes a few per tick
+  size_t fid;
+  ebbrt::clock::Wall::time_point expires;
+  for (size_t n = 0; hot_instances_are_enabled() && n < prewarm_batch &&
+                     root_.TakeDuePrewarm(now, fid, expires);
+       n++) {
+    prewarm_instance(fid, expires);
+  }
+  // Halt pre-warmed instances that were never used
+  while (!prewarmed_expiry_.empty() &&
+         prewarmed_expiry_.begin()->first <= now) {
+    auto it = prewarmed_instance_map_.find(prewarmed_expiry_.begin()->second);
+    kassert(it != prewarmed_instance_map_.end());
+    auto inst = it->second.first;
+    root_.ClearPrewarmedCore(it->first, core_);
+    prewarmed_expiry_.erase(it->second.second);
+    prewarmed_instance_map_.erase(it);
+    release_loaded_instance(inst);
+  }
+  reap_staged_instances(now);
+  // Give up on warm-up snapshots whose instance never went idle, another
+  // instance of the function can take one
+  for (auto it = pending_warm_snapshots_.begin();
+       it != pending_warm_snapshots_.end();) {
+    if (it->second.second <= now) {
+      SEUSS_LOG_WARN("C(%lu) warm-up snapshot of fid #%lu timed out\n", core_,
+                     it->second.first);
+      root_.ReleaseWarmSnapshot(it->second.first);
+      halt_instance(it->first);
+      it = pending_warm_snapshots_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  // Prewarms whose instance never went idle after /init
+  std::vector<ebbrt::Promise<bool>> timed_out;
+  for (auto it = pending_prewarms_.begin(); it != pending_prewarms_.end();) {
+    if (it->second.deadline <= now) {
+      SEUSS_LOG_WARN("C(%lu) prewarm snapshot of fid #%lu timed out\n", core_,
+                     it->second.fid);
+      halt_instance(it->first);
+      timed_out.emplace_back(std::move(it->second.stored));
+      it = pending_prewarms_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto &p : timed_out) {
+    p.SetValue(false);
+  }
+  root_.FreeRetiredSnapshots(now);
+}
+
 void seuss::Invoker::Resolve(seuss::InvocationStats istats, std::string ret) {
   // Pass along to output channel
   seuss_channel->SendReply(
       ebbrt::Messenger::NetworkId(ebbrt::runtime::Frontend()), istats, ret);
 }
 
-bool seuss::Invoker::process_cold_start(seuss::Invocation i) {
+ebbrt::Future<bool>
+seuss::Invoker::process_cold_start(const seuss::Invocation &i) {
 
   auto istats = i.info; // Invocation Statistics 
-  const std::string args = i.args;
-  const std::string code = i.code;
+  auto args = i.args;
+  auto code = i.code;
   const size_t fid = istats.function_id;
-  ebbrt::clock::Wall::time_point operation_start_time;
+  istats.exec.start_type = StartType::cold;
+
+  /* Use an instance of the base snapshot staged on this core, if ready */
+  auto staged = std::find_if(staged_base_.begin(), staged_base_.end(),
+                             [](const staged_instance &s) { return s.ready; });
+  if (staged != staged_base_.end()) {
+    auto umi_id = staged->inst.umi_id;
+    auto port = staged->inst.port;
+    auto hot_sv_f = std::move(staged->snapshot);
+    staged_base_.erase(staged);
+    SEUSS_LOG_INFO("C(%lu)[%lu] cold start (staged): tid=%lx, %lu, %lu\n",
+                   core_, invctr_, istats.transaction_id, fid, umi_id);
+    // The port was registered and the checkpoint set when it was staged
+    InvocationSession *umsesh =
+        new_invocation_session(istats, fid, umi_id, std::move(args),
+                               std::move(code), port);
+    capture_snapshot(std::move(hot_sv_f), umsesh);
+    /* Already loaded, go straight to start */
+    start_instance(umsesh, umi_id);
+    return when_session_finished(umsesh);
+  }
+
+  // Cold starts are happening, keep base instances staged
+  stage_base_ = true;
 
   /* Load up the base snapshot environment */
   auto base_env = root_.GetBaseSV();
@@ -359,95 +844,227 @@ bool seuss::Invoker::process_cold_start(seuss::Invocation i) {
   /* Create new UM instance for this invocation */
   auto umi = std::make_unique<umm::UmInstance>(*base_env);
   auto umi_id = umi->Id();
-  kprintf_force("C(%d)[%d]" CYAN "cold start" RESET ": %s, %u, %u\n",
-                core_, invctr_, istats.activation_id, fid,
-                umi_id);
+  SEUSS_LOG_INFO("C(%lu)[%lu] cold start: tid=%lx, %lu, %lu\n", core_,
+                 invctr_, istats.transaction_id, fid, umi_id);
+
+  /* Make a new TCP connection with the instance */
+  InvocationSession *umsesh =
+      new_invocation_session(istats, fid, umi_id, std::move(args),
+                             std::move(code));
+  umi->RegisterPort(umsesh->SrcPort());
 
   /* Snapshotting */
   if (!root_.CacheIsFull()) {
-    ebbrt::Future<umm::UmSV *> hot_sv_f =
-        umi->SetCheckpoint(umm::ElfLoader::GetSymbolAddress("uv_uptime"));
-    // When you have the sv, cache it.
-    hot_sv_f.Then([this, fid](ebbrt::Future<umm::UmSV *> f) {
-      root_.SetSnapshot(fid, std::move(f.Get()));
-    });
+    capture_snapshot(
+        umi->SetCheckpoint(umm::ElfLoader::GetSymbolAddress("uv_uptime")),
+        umsesh);
   }else{
-    kprintf_force(YELLOW "Cache full! Skipping snapshot #%u\n" RESET, fid);
+    SEUSS_LOG_WARN("Cache full! Skipping snapshot #%lu\n", fid);
   }
 
-  /* Make a new TCP connection with the instance */
+  /* load -> start: once the instance is loaded */
+  umm::manager->Load(std::move(umi)).Then([this, umsesh, umi_id](auto f) {
+    start_instance(umsesh, umi_id);
+  });
+
+  return when_session_finished(umsesh).Then(
+      [this, istats, fid, umi_id](ebbrt::Future<bool> f) {
+        auto status = f.Get();
+        if (status)
+          SEUSS_LOG_DEBUG("C(%lu) cold finish: tid=%lx, %lu, %lu\n", core_,
+                          istats.transaction_id, fid, umi_id);
+        return status;
+      });
+}
+
+ebbrt::Future<bool> seuss::Invoker::process_prewarm(seuss::Invocation i) {
+  auto istats = i.info;
+  const size_t fid = istats.function_id;
+  istats.exec.start_type = StartType::cold;
+
+  /* Nothing to do if the snapshot exists, or there's no room for it */
+  if (root_.GetSnapshot(fid) || root_.CacheIsFull()) {
+    return ebbrt::MakeReadyFuture<bool>(false);
+  }
+
+  auto base_env = root_.GetBaseSV();
+  auto umi = std::make_unique<umm::UmInstance>(*base_env);
+  auto umi_id = umi->Id();
+  SEUSS_LOG_INFO("C(%lu) prewarm: %lu, %lu\n", core_, fid, umi_id);
+
   InvocationSession *umsesh =
-      new_invocation_session(&istats, fid, umi_id, args, code);
+      new_invocation_session(istats, fid, umi_id, "" /*no args*/,
+                             std::move(i.code));
+  umsesh->SetPrewarm(true);
   umi->RegisterPort(umsesh->SrcPort());
 
-  /* Block flow control until the instance is loaded */
-  umm::manager->Load(std::move(umi)).Block(); 
+  /* The snapshot is taken after /init (see SessionInitialized) */
+  auto &pending = pending_prewarms_[umi_id];
+  pending.fid = fid;
+  pending.deadline = ebbrt::clock::Wall::time_point::max();
+  auto ret = pending.stored.GetFuture();
+  when_session_finished(umsesh).Then([this, umi_id](ebbrt::Future<bool> f) {
+    // Failed before /init, the instance is already halted
+    if (!f.Get())
+      finish_prewarm(umi_id, false);
+  });
 
-  /* Start run of the instance */
-  ebbrt::event_manager->SpawnLocal([umi_id]() { umm::manager->Start(umi_id); });
+  /* load -> start: once the instance is loaded */
+  umm::manager->Load(std::move(umi)).Then([this, umsesh, umi_id](auto f) {
+    start_instance(umsesh, umi_id);
+  });
+  return ret;
+}
 
-  /* Spawn a new event to make a connection with the instance */
+void seuss::Invoker::finish_prewarm(umm::umi::id umi_id, bool stored) {
+  auto it = pending_prewarms_.find(umi_id);
+  if (it == pending_prewarms_.end())
+    return;
+  auto p = std::move(it->second.stored);
+  pending_prewarms_.erase(it);
+  p.SetValue(stored);
+}
+
+void seuss::Invoker::capture_snapshot(ebbrt::Future<umm::UmSV *> hot_sv_f,
+                                     InvocationSession *umsesh) {
+  auto fid = umsesh->Stats().function_id;
+  // When you have the sv, cache it.
+  hot_sv_f.Then([this, fid](ebbrt::Future<umm::UmSV *> f) {
+    cache_snapshot(fid, std::move(f.Get()));
+  });
+}
+
+bool seuss::Invoker::cache_snapshot(size_t fid, umm::UmSV *sv) {
+  if (!root_.SetSnapshot(fid, sv))
+    return false;
+  // The controller tracks which nodes hold a function's snapshot
+  auto istats = InvocationStats();
+  istats.function_id = fid;
+  seuss_channel->SendReply(
+      ebbrt::Messenger::NetworkId(ebbrt::runtime::Frontend()), istats,
+      std::string(), MsgType::snapshot_stored);
+  return true;
+}
+
+bool seuss::Invoker::capture_warm_snapshot(InvocationSession *umsesh) {
+  if (!jit_warmup_runs_)
+    return false;
+  auto fid = umsesh->Stats().function_id;
+  auto umi_id = umsesh->InstanceId();
+  // Instances are parked after each run, this one is not parked yet
+  auto it = stalled_instance_usage_count_.find(umi_id);
+  uint32_t runs = (it == stalled_instance_usage_count_.end() ? 0 : it->second);
+  if (runs + 1 < jit_warmup_runs_ || !root_.ClaimWarmSnapshot(fid))
+    return false;
+  stalled_instance_usage_count_.erase(umi_id);
+  SEUSS_LOG_INFO("C(%lu) re-snapshot of fid #%lu after %lu runs\n", core_, fid,
+                 runs + 1);
+  /* Drop the connection and take the snapshot the next time the runtime
+   * idles, i.e., between requests and without an open socket */
+  release_session_port(umsesh);
+  auto umi = umm::manager->GetInstance(umi_id);
+  ebbrt::kbugon(!umi);
+  auto deadline = ebbrt::clock::Wall::Now() +
+                  std::chrono::milliseconds(warm_snapshot_timeout_ms);
+  pending_warm_snapshots_.emplace(umi_id, std::make_pair(fid, deadline));
+  umi->SetCheckpoint(umm::ElfLoader::GetSymbolAddress(warm_snapshot_symbol))
+      .Then([this, fid, umi_id](ebbrt::Future<umm::UmSV *> f) {
+        auto sv = f.Get();
+        if (!pending_warm_snapshots_.erase(umi_id)) {
+          // Timed out, the claim was given back
+          delete sv;
+          return;
+        }
+        root_.ReplaceSnapshot(fid, sv);
+        halt_instance(umi_id);
+      });
+  return true;
+}
+
+std::unique_ptr<umm::UmInstance>
+seuss::Invoker::restore_instance(umm::UmSV *sv) {
+  root_.RetainSnapshot(sv);
+  auto umi = std::make_unique<umm::UmInstance>(*sv);
+  instance_snapshot_.emplace(umi->Id(), sv);
+  return umi;
+}
+
+void seuss::Invoker::halt_instance(umm::umi::id umi_id) {
+  umm::UmSV *sv = nullptr;
+  auto it = instance_snapshot_.find(umi_id);
+  if (it != instance_snapshot_.end()) {
+    sv = it->second;
+    instance_snapshot_.erase(it);
+  }
   ebbrt::event_manager->SpawnLocal(
-      [this, umsesh] {
-        // Start a new TCP connection with the http request
-        umsesh->Connect();
+      [this, umi_id, sv] {
+        umm::manager->SignalHalt(umi_id);
+        // The snapshot may be freed once its last instance is gone
+        if (sv)
+          root_.ReleaseSnapshot(sv);
       },
       /* async */ true);
-
-  // Block flow control until session has finished 
-  umsesh->WhenFinished().Block();
-  auto status = umsesh->WhenFinished().Get();
-  if (status)
-    kprintf("C(%d) " CYAN "cold finish" RESET ": %s, %u, %u\n",
-            (size_t)ebbrt::Cpu::GetMine(), istats.activation_id, fid, umi_id);
-  delete umsesh;
-  return status;
 }
 
-bool seuss::Invoker::process_warm_start(seuss::Invocation i) {
+ebbrt::Future<bool>
+seuss::Invoker::process_warm_start(const seuss::Invocation &i) {
 
   auto istats = i.info; // Invocation Statistics 
-  const std::string args = i.args;
   const size_t fid = istats.function_id;
 
+  istats.exec.start_type = StartType::warm;
   /* Mark a warm start with Init Time = 1 */
   istats.exec.init_time = 1;
 
   /* Check snapshot cache for function-specific snapshot */
   auto cached_snap = root_.GetSnapshot(fid);
   if (cached_snap == nullptr) {
-    return false;
+    return ebbrt::MakeReadyFuture<bool>(false);
   }
 
-  /* Create new UM instance for this invocation */
-  auto umi = std::make_unique<umm::UmInstance>(*cached_snap);
-  auto umi_id = umi->Id();
-  kprintf_force("C(%d)%d[%d] " YELLOW "warm start" RESET ": %s, %u, %u\n",
-                core_, invctr_,request_concurrency_.load(), istats.activation_id, fid,
-                umi_id);
-
-  /* Make a new invocation session with the instance */
-  InvocationSession *umsesh =
-      new_invocation_session(&istats, fid, umi_id, args /*no code*/);
-  umi->RegisterPort(umsesh->SrcPort());
-
-  /* Block flow control until the instance is loaded */
-  umm::manager->Load(std::move(umi)).Block(); 
-
-  /* Start run of the instance */
-  ebbrt::event_manager->SpawnLocal([umi_id]() { umm::manager->Start(umi_id); });
-
-  /* Start new event to make a connection with the instance */
-  ebbrt::event_manager->SpawnLocal([this, umsesh] { umsesh->Connect(); }, true);
+  auto args = i.args;
+  InvocationSession *umsesh;
+  /* Use a pre-warmed or staged instance if one was loaded for this function */
+  uint16_t port = 0;
+  auto umi_id = get_prewarmed_instance(fid, port);
+  if (!umi_id)
+    umi_id = take_staged_warm(fid, port);
+  if (umi_id) {
+    SEUSS_LOG_INFO("C(%lu)%lu[%lu] warm start (pre-warmed): tid=%lx, %lu\n",
+                   core_, invctr_, request_concurrency_.load(),
+                   istats.transaction_id, fid);
+    // The port was registered before the instance was loaded
+    umsesh = new_invocation_session(istats, fid, umi_id,
+                                    std::move(args) /*no code*/, "", port);
+    /* Already loaded, go straight to start */
+    start_instance(umsesh, umi_id);
+  } else {
+    /* Create new UM instance for this invocation */
+    auto umi = restore_instance(cached_snap);
+    umi_id = umi->Id();
+    SEUSS_LOG_INFO("C(%lu)%lu[%lu] warm start: tid=%lx, %lu\n", core_,
+                   invctr_, request_concurrency_.load(), istats.transaction_id,
+                   fid);
+
+    /* Make a new invocation session with the instance */
+    umsesh = new_invocation_session(istats, fid, umi_id,
+                                    std::move(args) /*no code*/);
+    umi->RegisterPort(umsesh->SrcPort());
+
+    /* load -> start: once the instance is loaded */
+    umm::manager->Load(std::move(umi)).Then([this, umsesh, umi_id](auto f) {
+      start_instance(umsesh, umi_id);
+    });
+  }
 
-  // Block flow control until session has finished 
-  umsesh->WhenFinished().Block();
-  auto status = umsesh->WhenFinished().Get();
-  if (status)
-    kprintf("C(%d) " YELLOW "warm finish" RESET ": %s, %u, %u\n",
-            core_, istats.activation_id, fid, umi_id);
-  delete umsesh;
-  return status;
+  return when_session_finished(umsesh).Then(
+      [this, istats, fid, umi_id](ebbrt::Future<bool> f) {
+        auto status = f.Get();
+        if (status)
+          SEUSS_LOG_DEBUG("C(%lu) warm finish: tid=%lx, %lu, %lu\n", core_,
+                          istats.transaction_id, fid, umi_id);
+        return status;
+      });
 }
 
 bool seuss::Invoker::hot_instance_exists(size_t fid) {
@@ -458,58 +1075,305 @@ bool seuss::Invoker::hot_instance_exists(size_t fid) {
   return false; 
 }
 
-umm::umi::id seuss::Invoker::get_hot_instance(size_t fid) {
+umm::umi::id seuss::Invoker::get_hot_instance(size_t fid,
+                                              InvocationSession *&umsesh) {
   auto it = stalled_instance_map_.find(fid);
   if (it != stalled_instance_map_.end()) {
-    umm::umi::id ret = it->second;
-    stalled_instance_map_.erase(fid);
-    // remove instance from fifo
-    auto loc = std::find(stalled_instance_fifo_.begin(), stalled_instance_fifo_.end(), fid);
-    if( loc != stalled_instance_fifo_.end()){
-      stalled_instance_fifo_.erase(loc);
-    } 
+    // Take the most-recently-saved instance of this function
+    auto lru_it = it->second.back();
+    umm::umi::id ret = lru_it->umi_id;
+    umsesh = lru_it->session;
+    stalled_expiry_.erase(lru_it->expiry_pos);
+    it->second.pop_back();
+    if (it->second.empty()) {
+      stalled_instance_map_.erase(it);
+    }
+    stalled_instance_lru_.erase(lru_it);
     return ret;
   }
   ebbrt::kabort("Tried to get a non-existant instance\n");
   return umm::umi::null_id;
 }
 
+void seuss::Invoker::release_hot_instance(hot_instance_lru::iterator lru_it) {
+  auto victim = *lru_it;
+  auto it = stalled_instance_map_.find(victim.fid);
+  kassert(it != stalled_instance_map_.end());
+  it->second.erase(victim.fn_pos);
+  stalled_expiry_.erase(victim.expiry_pos);
+  if (it->second.empty()) {
+    stalled_instance_map_.erase(it);
+  }
+  stalled_instance_lru_.erase(lru_it);
+  stalled_instance_usage_count_.erase(victim.umi_id);
+  SEUSS_LOG_DEBUG("Releasing idle instance %lu (fid #%lu)\n", victim.umi_id,
+                  victim.fid);
+  auto umi_id = victim.umi_id;
+  halt_instance(umi_id);
+  discard_session(victim.session);
+}
+
+uint16_t seuss::Invoker::get_internal_port() {
+  auto port = ports_.Allocate();
+  // Idle instances hold on to their ports, give one up if we ran out
+  if (!port && !stalled_instance_lru_.empty()) {
+    evict_hot_instance();
+    port = ports_.Allocate();
+  }
+  if (!port) {
+    ebbrt::kabort("C%d: Out of session source ports\n", core_);
+  }
+  return port;
+}
+
+void seuss::Invoker::evict_hot_instance() {
+  kassert(!stalled_instance_lru_.empty());
+  release_hot_instance(stalled_instance_lru_.begin());
+}
+
+void seuss::Invoker::prewarm_instance(size_t fid,
+                                      ebbrt::clock::Wall::time_point expires) {
+  if (prewarmed_instance_map_.find(fid) != prewarmed_instance_map_.end()) {
+    return;
+  }
+  auto cached_snap = root_.GetSnapshot(fid);
+  if (cached_snap == nullptr) {
+    return;
+  }
+  auto umi = restore_instance(cached_snap);
+  auto inst = loaded_instance{umi->Id(), register_instance_port(*umi)};
+  SEUSS_LOG_DEBUG("Pre-warming instance %lu (fid #%lu)\n", inst.umi_id, fid);
+  umm::manager->Load(std::move(umi)).Then([this, fid, inst, expires](auto f) {
+    if (prewarmed_instance_map_.find(fid) != prewarmed_instance_map_.end()) {
+      release_loaded_instance(inst);
+      return;
+    }
+    prewarmed_instance_map_.emplace(
+        fid, std::make_pair(inst, prewarmed_expiry_.emplace(expires, fid)));
+    // The function's next arrival is sent to this core
+    root_.SetPrewarmedCore(fid, core_);
+  });
+}
+
+umm::umi::id seuss::Invoker::get_prewarmed_instance(size_t fid,
+                                                    uint16_t &port) {
+  auto it = prewarmed_instance_map_.find(fid);
+  if (it == prewarmed_instance_map_.end()) {
+    return umm::umi::null_id;
+  }
+  auto ret = it->second.first.umi_id;
+  port = it->second.first.port;
+  root_.ClearPrewarmedCore(fid, core_);
+  prewarmed_expiry_.erase(it->second.second);
+  prewarmed_instance_map_.erase(it);
+  return ret;
+}
+
+uint16_t seuss::Invoker::register_instance_port(umm::UmInstance &umi) {
+  auto port = get_internal_port();
+  umi.RegisterPort(port);
+  return port;
+}
+
+void seuss::Invoker::release_loaded_instance(loaded_instance inst) {
+  // Never started, so there is no connection on the port
+  ports_.Release(inst.port);
+  auto umi_id = inst.umi_id;
+  halt_instance(umi_id);
+}
+
+void seuss::Invoker::record_function_hit(size_t fid) {
+  function_hits_[fid]++;
+  // Decay the counts so popularity follows the recent load
+  if (++hits_since_decay_ >= staged_decay_interval) {
+    hits_since_decay_ = 0;
+    for (auto it = function_hits_.begin(); it != function_hits_.end();) {
+      it->second /= 2;
+      if (it->second == 0) {
+        it = function_hits_.erase(it);
+      } else {
+        ++it;
+      }
+    }
+  }
+}
+
+std::vector<size_t> seuss::Invoker::top_functions(size_t k) {
+  std::vector<std::pair<uint32_t, size_t>> ranked;
+  ranked.reserve(function_hits_.size());
+  for (auto &h : function_hits_) {
+    ranked.emplace_back(h.second, h.first);
+  }
+  if (ranked.size() > k) {
+    std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(),
+                      std::greater<std::pair<uint32_t, size_t>>());
+    ranked.resize(k);
+  }
+  std::vector<size_t> ret;
+  for (auto &r : ranked) {
+    ret.push_back(r.second);
+  }
+  return ret;
+}
+
+umm::umi::id seuss::Invoker::take_staged_warm(size_t fid, uint16_t &port) {
+  auto it = staged_warm_.find(fid);
+  if (it == staged_warm_.end()) {
+    return umm::umi::null_id;
+  }
+  auto ret = it->second.inst.umi_id;
+  port = it->second.inst.port;
+  staged_warm_.erase(it);
+  return ret;
+}
+
+void seuss::Invoker::reap_staged_instances(ebbrt::clock::Wall::time_point now) {
+  // A handful per core, a scan is cheaper than keeping them ordered
+  for (auto it = staged_base_.begin(); it != staged_base_.end();) {
+    if (it->ready && it->expires <= now) {
+      release_loaded_instance(it->inst);
+      it = staged_base_.erase(it);
+      // Not restaged until the next cold start
+      stage_base_ = false;
+    } else {
+      ++it;
+    }
+  }
+  for (auto it = staged_warm_.begin(); it != staged_warm_.end();) {
+    if (it->second.expires <= now) {
+      release_loaded_instance(it->second.inst);
+      // Idle for its whole window, it is no longer popular
+      function_hits_.erase(it->first);
+      it = staged_warm_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void seuss::Invoker::refill_staged_instances() {
+  refill_pcb_pool();
+  // One load at a time, and only while there is no queued work
+  if (staging_ || !root_.IsBootstrapped() || root_.HasWork()) {
+    return;
+  }
+
+  /* Instances of the base snapshot, for cold starts */
+  if (stage_base_ && staged_base_.size() < default_staged_base &&
+      !root_.CacheIsFull()) {
+    auto base_env = root_.GetBaseSV();
+    auto umi = std::make_unique<umm::UmInstance>(*base_env);
+    auto umi_id = umi->Id();
+    // The port and checkpoint have to be set before the instance is loaded
+    auto inst = loaded_instance{umi_id, register_instance_port(*umi)};
+    // Instances of the base are kept as long as any function without a
+    // representative arrival histogram
+    auto window = ArrivalHistogram().Window();
+    auto expires = ebbrt::clock::Wall::Now() +
+                   std::chrono::milliseconds(window.keep_alive_ms);
+    auto snapshot =
+        umi->SetCheckpoint(umm::ElfLoader::GetSymbolAddress("uv_uptime"));
+    staged_base_.push_back(
+        staged_instance{inst, std::move(snapshot), false, expires});
+    staging_ = true;
+    umm::manager->Load(std::move(umi)).Then([this, umi_id](auto f) {
+      staging_ = false;
+      for (auto &s : staged_base_) {
+        if (s.inst.umi_id == umi_id)
+          s.ready = true;
+      }
+      ebbrt::event_manager->SpawnLocal(
+          []() { seuss::invoker->refill_staged_instances(); }, true);
+    });
+    return;
+  }
+
+  /* Instances of the most popular function snapshots, for warm starts */
+  auto top = top_functions(default_staged_functions);
+  // Drop staged instances of functions that are no longer popular
+  for (auto it = staged_warm_.begin(); it != staged_warm_.end();) {
+    if (std::find(top.begin(), top.end(), it->first) == top.end()) {
+      release_loaded_instance(it->second.inst);
+      it = staged_warm_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (auto fid : top) {
+    if (staged_warm_.find(fid) != staged_warm_.end() ||
+        prewarmed_instance_map_.find(fid) != prewarmed_instance_map_.end()) {
+      continue;
+    }
+    auto cached_snap = root_.GetSnapshot(fid);
+    if (cached_snap == nullptr) {
+      continue;
+    }
+    auto umi = restore_instance(cached_snap);
+    auto inst = loaded_instance{umi->Id(), register_instance_port(*umi)};
+    staging_ = true;
+    umm::manager->Load(std::move(umi)).Then([this, fid, inst](auto f) {
+      staging_ = false;
+      // Kept as long as an idle instance of the function would be
+      auto window = root_.GetKeepAliveWindow(fid);
+      auto expires = ebbrt::clock::Wall::Now() +
+                     std::chrono::milliseconds(window.keep_alive_ms);
+      bool inserted;
+      std::tie(std::ignore, inserted) =
+          staged_warm_.emplace(fid, staged_warm_instance{inst, expires});
+      if (!inserted) {
+        release_loaded_instance(inst);
+      }
+      ebbrt::event_manager->SpawnLocal(
+          []() { seuss::invoker->refill_staged_instances(); }, true);
+    });
+    return;
+  }
+}
+
 bool seuss::Invoker::hot_instance_can_be_reused(umm::umi::id id) {
   kassert(id);
-  // Check hot instance limit on this core has been hit
-  auto c = stalled_instance_map_.size();
-  if (c >= hot_instance_limit_) {
-    return false;
-  }
   // Check reuse limit on instance 
   auto it = stalled_instance_usage_count_.find(id);
   if (it != stalled_instance_usage_count_.end()) {
     if (it->second <= hot_instance_reuse_limit_) {
       return true;
     }
-    kprintf_force(CYAN "Reuse limit reached for instance %d\n" RESET, id);
+    SEUSS_LOG_DEBUG("Reuse limit reached for instance %lu\n", id);
     return false;
   }
   // No record of this instance
   return true;
 }
 
-bool seuss::Invoker::save_hot_instance(size_t fid, umm::umi::id umi_id){
+bool seuss::Invoker::save_hot_instance(size_t fid, umm::umi::id umi_id,
+                                       InvocationSession *umsesh) {
   kassert(fid);
   kassert(umi_id);
 
+  if (!hot_instances_are_enabled()) {
+    return false;
+  }
+
   if(!hot_instance_can_be_reused(umi_id)){
+    stalled_instance_usage_count_.erase(umi_id);
     return false; // this instance hit its reuse limit
   }
 
-  if(hot_instance_exists(fid)){
-    return false; // an instance for this function already exists
+  // Functions with a long idle head are released now and pre-warmed later
+  auto now = ebbrt::clock::Wall::Now();
+  auto window = root_.GetKeepAliveWindow(fid);
+  if (window.prewarm_ms > 0) {
+    auto load_time = now + std::chrono::milliseconds(window.prewarm_ms);
+    root_.SchedulePrewarm(
+        fid, load_time,
+        load_time + std::chrono::milliseconds(window.keep_alive_ms));
+    stalled_instance_usage_count_.erase(umi_id);
+    return false;
   }
 
-  auto it = stalled_instance_map_.find(fid);
-  if (it != stalled_instance_map_.end()) {
-    //Tried to double-save a spicy instance
-    return false;
+  // Make room by evicting the least-recently-used idle instance
+  if (stalled_instance_lru_.size() >= hot_instance_limit_) {
+    evict_hot_instance();
   }
 
   // Increase the use counter 
@@ -528,45 +1392,67 @@ bool seuss::Invoker::save_hot_instance(size_t fid, umm::umi::id umi_id){
   umm::manager->SignalYield(umi_id); // ugly that this is 2 steps
 
   // Register UMI for future hot starts
-  stalled_instance_map_.emplace(fid, umi_id);
-  stalled_instance_fifo_.push_back(fid);
+  auto expires = now + std::chrono::milliseconds(window.keep_alive_ms);
+  auto lru_it = stalled_instance_lru_.insert(
+      stalled_instance_lru_.end(),
+      hot_instance{fid, umi_id, umsesh, hot_instance_list::iterator(),
+                   hot_instance_expiry::iterator()});
+  umsesh->SetParked(true);
+  auto &instances = stalled_instance_map_[fid];
+  lru_it->fn_pos = instances.insert(instances.end(), lru_it);
+  lru_it->expiry_pos = stalled_expiry_.emplace(expires, lru_it);
   return true;
 }
 
-bool seuss::Invoker::process_hot_start(seuss::Invocation i) {
+ebbrt::Future<bool>
+seuss::Invoker::process_hot_start(const seuss::Invocation &i) {
 
   auto istats = i.info; // Invocation Statistics 
-  const std::string args = i.args;
   const size_t fid = istats.function_id;
+  istats.exec.start_type = StartType::hot;
 
   if (!hot_instances_are_enabled()) {
-    return false;
+    return ebbrt::MakeReadyFuture<bool>(false);
   }
 
   if (!hot_instance_exists(fid)) {
-    return false;
+    return ebbrt::MakeReadyFuture<bool>(false);
   }
 
-  /* Get UM instance for this function */
-  auto umi_id = get_hot_instance(fid);
+  /* Get UM instance (and its idle session) for this function */
+  InvocationSession *umsesh = nullptr;
+  auto umi_id = get_hot_instance(fid, umsesh);
   auto umi = umm::manager->GetInstance(umi_id);
   if (!umi_id || !umi) {
     kprintf(YELLOW "WARNING: Hot instance thought to exist but was not found: "
                    "fid=%u umi_id=%u \n" RESET,
             fid, umi_id);
-    return false;
+    if (umsesh)
+      discard_session(umsesh);
+    return ebbrt::MakeReadyFuture<bool>(false);
+  }
+  SEUSS_LOG_INFO("C(%lu):%lu[%lu,%lu] hot start: tid=%lx, %lu, %lu\n", core_,
+                 invctr_, request_concurrency_.load(),
+                 stalled_instance_lru_.size(), istats.transaction_id, fid,
+                 umi_id);
+
+  auto args = i.args;
+  if (umsesh && umsesh->IsConnected()) {
+    /* Reuse the idle keep-alive connection, skipping the TCP handshake */
+    umsesh->Rearm();
+    arm_invocation_session(umsesh, istats, fid, umi_id,
+                           std::move(args) /*no code*/);
+    ebbrt::event_manager->SpawnLocal([umsesh] { umsesh->Reuse(); }, true);
+  } else {
+    /* The instance dropped the idle connection, make a new one */
+    if (umsesh)
+      discard_session(umsesh);
+    umsesh = new_invocation_session(istats, fid, umi_id,
+                                    std::move(args) /*no code*/);
+    umsesh->SetPhase(InvocationSession::Phase::start);
+    // Start connection in a separate event
+    ebbrt::event_manager->SpawnLocal([umsesh] { umsesh->Connect(); }, true);
   }
-  kprintf_force("C(%d):%d[%d,%d] " RED "hot start" RESET " %s, %u, %u\n",
-                core_, invctr_, request_concurrency_.load(),
-                stalled_instance_fifo_.size(), istats.activation_id,
-                fid, umi_id);
-
-  /* Make a new invocation session with the instance */
-  InvocationSession *umsesh =
-      new_invocation_session(&istats, fid, umi_id, args /*no code*/);
-
-  // Start connection in a separate event
-  ebbrt::event_manager->SpawnLocal([umsesh] { umsesh->Connect(); }, true);
 
   /* Prep UMI and signal it to be schedule */
   umi->pfc.zero_ctrs();
@@ -574,86 +1460,208 @@ bool seuss::Invoker::process_hot_start(seuss::Invocation i) {
   umi->SetActive();
   umm::manager->SignalResume(umi_id);
 
-  // Block flow control until session has closed/aborted
-  umsesh->WhenFinished().Block();
-  auto status = umsesh->WhenFinished().Get();
-  if(status)
-    kprintf("C(%d):[%d,%d] " RED "hot finish" RESET " %s, %u, %u\n",
-            core_, request_concurrency_.load(),
-            stalled_instance_fifo_.size(), istats.activation_id, fid, umi_id);
-  delete umsesh;
-  return status;
+  return when_session_finished(umsesh).Then(
+      [this, istats, fid, umi_id](ebbrt::Future<bool> f) {
+        auto status = f.Get();
+        if (status)
+          SEUSS_LOG_DEBUG("C(%lu):[%lu,%lu] hot finish: tid=%lx, %lu, %lu\n",
+                          core_, request_concurrency_.load(),
+                          stalled_instance_lru_.size(), istats.transaction_id,
+                          fid, umi_id);
+        return status;
+      });
 }
 
 seuss::InvocationSession *
-seuss::Invoker::new_invocation_session(seuss::InvocationStats *istats,
+seuss::Invoker::new_invocation_session(seuss::InvocationStats istats,
                                const size_t fid,
                                const umm::umi::id umi_id,
-                               const std::string args,
-                               const std::string code ) {
+                               std::string args,
+                               std::string code,
+                               uint16_t src_port) {
+
+  auto umsesh = alloc_session(src_port ? src_port : get_internal_port());
+  arm_invocation_session(umsesh, istats, fid, umi_id, std::move(args),
+                         std::move(code));
+  return umsesh;
+}
+
+void seuss::Invoker::release_session_port(InvocationSession *umsesh) {
+  // The port is reused once released, the connection on it must be gone
+  umsesh->Disconnect();
+  ports_.Release(umsesh->SrcPort());
+}
 
-  auto pcb = new ebbrt::NetworkManager::TcpPcb;
-  auto umsesh = new InvocationSession(std::move(*pcb), get_internal_port());
+void seuss::Invoker::discard_session(InvocationSession *umsesh) {
+  release_session_port(umsesh);
+  // Deferred, a closed/aborted event may still be pending on the session
+  ebbrt::event_manager->SpawnLocal(
+      [umsesh] { seuss::invoker->recycle_session(umsesh); }, true);
+}
 
-  umsesh->WhenConnected().Then([umsesh, args, code](auto f) {
+seuss::InvocationSession *seuss::Invoker::alloc_session(uint16_t src_port) {
+  if (session_pool_.empty()) {
+    return new InvocationSession(ebbrt::NetworkManager::TcpPcb(), src_port);
+  }
+  auto umsesh = session_pool_.back();
+  session_pool_.pop_back();
+  umsesh->Reset(src_port, take_pcb());
+  return umsesh;
+}
+
+ebbrt::NetworkManager::TcpPcb seuss::Invoker::take_pcb() {
+  if (pcb_pool_.empty())
+    return ebbrt::NetworkManager::TcpPcb();
+  auto pcb = std::move(pcb_pool_.back());
+  pcb_pool_.pop_back();
+  return pcb;
+}
+
+void seuss::Invoker::refill_pcb_pool() {
+  while (pcb_pool_.size() < default_session_pool_size)
+    pcb_pool_.emplace_back();
+}
+
+void seuss::Invoker::recycle_session(InvocationSession *umsesh) {
+  if (session_pool_.size() >= default_session_pool_size) {
+    delete umsesh;
+    return;
+  }
+  session_pool_.push_back(umsesh);
+}
+
+void seuss::Invoker::arm_invocation_session(
+    InvocationSession *umsesh, seuss::InvocationStats istats, const size_t fid,
+    const umm::umi::id umi_id, std::string args, std::string code) {
+
+  umsesh->SetStats(istats);
+  umsesh->SetPayload(std::move(args), std::move(code));
+  // Keep the connection open for the next hot start
+  umsesh->SetKeepAlive(hot_instances_are_enabled());
+
+  umsesh->SetHandler(this);
+  umsesh->SetInstanceId(umi_id);
+}
+
+void seuss::Invoker::SessionConnected(InvocationSession *umsesh) {
 #if DEBUG_PRINT_SEUSS
-    kprintf_force(CYAN "C%d:sCon " RESET, (size_t)ebbrt::Cpu::GetMine());  
+  kprintf_force(CYAN "C%d:sCon " RESET, (size_t)ebbrt::Cpu::GetMine());
 #endif
-    if (code != std::string()) {
-      /* If we have code, initialize it and keep the connection alive */
-      umsesh->SendHttpRequest("/init", code, true /* keep_alive */);
-    } else {
-      /* If not given code, start execution and signal the receiver to close the
-       * connection after done */
-      umsesh->SendHttpRequest("/run", args, false /* close connection */);
-    }
-  });
+  if (umsesh->HasCode()) {
+    /* If we have code, initialize it and keep the connection alive */
+    umsesh->SendHttpRequest("/init", true /* keep_alive */);
+  } else {
+    /* If not given code, start execution and signal the receiver to close
+     * the connection after done (unless we intend to keep the instance) */
+    umsesh->SendHttpRequest("/run", umsesh->KeepAlive());
+  }
+}
 
+void seuss::Invoker::SessionInitialized(InvocationSession *umsesh) {
   /* When initialized send the run request */
-  umsesh->WhenInitialized().Then([umsesh, istats, args](auto f) {
 #if DEBUG_PRINT_SEUSS
-    kprintf_force(CYAN "C%d:sIn " RESET, (size_t)ebbrt::Cpu::GetMine()); 
+  kprintf_force(CYAN "C%d:sIn " RESET, (size_t)ebbrt::Cpu::GetMine());
 #endif
-    // Record initialization time, send run operation
-    istats->exec.init_time = umsesh->get_inittime();
-    umsesh->SendHttpRequest("/run", args, false /* keep_alive */);
-  });
+  // Record initialization time, send run operation
+  umsesh->Stats().exec.init_time = umsesh->Stats().exec.us.init / 1000;
+  if (umsesh->IsPrewarm()) {
+    /* Drop the connection and snapshot the initialized function the next
+     * time the runtime idles, the instance is halted once it is taken */
+    auto fid = umsesh->Stats().function_id;
+    auto umi_id = umsesh->InstanceId();
+    release_session_port(umsesh);
+    umsesh->Finish(true);
+    auto it = pending_prewarms_.find(umi_id);
+    kassert(it != pending_prewarms_.end());
+    it->second.deadline = ebbrt::clock::Wall::Now() +
+                          std::chrono::milliseconds(warm_snapshot_timeout_ms);
+    auto umi = umm::manager->GetInstance(umi_id);
+    ebbrt::kbugon(!umi);
+    umi->SetCheckpoint(umm::ElfLoader::GetSymbolAddress(warm_snapshot_symbol))
+        .Then([this, fid, umi_id](ebbrt::Future<umm::UmSV *> f) {
+          auto sv = f.Get();
+          if (pending_prewarms_.find(umi_id) == pending_prewarms_.end()) {
+            // Timed out, the instance was halted
+            delete sv;
+            return;
+          }
+          auto stored = cache_snapshot(fid, sv);
+          halt_instance(umi_id);
+          finish_prewarm(umi_id, stored);
+        });
+    return;
+  }
+  umsesh->SendHttpRequest("/run", umsesh->KeepAlive());
+}
 
+void seuss::Invoker::SessionExecuted(InvocationSession *umsesh) {
   /* Resolved invocation after successful execution successfully */
-  umsesh->WhenExecuted().Then([umsesh, istats](auto f) {
 #if DEBUG_PRINT_SEUSS
-    kprintf_force(CYAN "C%d:sEx " RESET, (size_t)ebbrt::Cpu::GetMine()); 
+  kprintf_force(CYAN "C%d:sEx " RESET, (size_t)ebbrt::Cpu::GetMine());
 #endif
-    istats->exec.status = 0; /* SUCCESSFUL */
-    istats->exec.run_time = umsesh->get_runtime();
-    // Alternatively, we could wait for the connection to close and do it then
-    seuss::invoker->Resolve(*istats, umsesh->GetReply());
-  });
+  auto &istats = umsesh->Stats();
+  auto fid = istats.function_id;
+  auto umi_id = umsesh->InstanceId();
+  istats.exec.status = 0; /* SUCCESSFUL */
+  istats.exec.run_time = istats.exec.us.run / 1000;
+  concurrency_.ObserveRunLatency(fid, istats.exec.us.run);
+  istats.exec.concurrency_limit = concurrency_.Limit();
+  // Alternatively, we could wait for the connection to close and do it then
+  Resolve(istats, umsesh->GetReply());
+  if (umsesh->KeepAlive()) {
+    /* Instances that ran N times have JIT compiled their hot code, snapshot
+     * one of them so that warm starts begin with the optimized code */
+    if (capture_warm_snapshot(umsesh)) {
+      umsesh->Finish(true);
+      return;
+    }
+    // Park the instance with its open connection for future hot starts
+    if (!save_hot_instance(fid, umi_id, umsesh)) {
+      // Unable to save, so we kill the instance and free its port
+      release_session_port(umsesh);
+      halt_instance(umi_id);
+    }
+    umsesh->Finish(true);
+  }
+}
 
+void seuss::Invoker::SessionClosed(InvocationSession *umsesh) {
   /* Finalize this invocation when connection has closed */
-  umsesh->WhenClosed().Then([this, umsesh, fid, umi_id](auto f) {
 #if DEBUG_PRINT_SEUSS
-    kprintf_force(CYAN "C%d:sCld " RESET, (size_t)ebbrt::Cpu::GetMine()); 
+  kprintf_force(CYAN "C%d:sCld " RESET, (size_t)ebbrt::Cpu::GetMine());
 #endif
-    //FIXME: Close doesn't necessarily mean 'success'
-    umsesh->Finish(true);
-    // Try and save this instance for future hot starts
-    if (! this->save_hot_instance(fid, umi_id)) {
-      // Unable to save, so we kill the instance
-      ebbrt::event_manager->SpawnLocal(
-          [umi_id] { umm::manager->SignalHalt(umi_id); },
-          /* async */ true);
-    }
-  });
+  // Keep-alive session already finished; if it is parked, the next hot
+  // start will notice the dropped connection and reconnect
+  if (umsesh->IsParked() ||
+      umsesh->GetPhase() == InvocationSession::Phase::finished) {
+    return;
+  }
+  auto umi_id = umsesh->InstanceId();
+  // Closed before the response (e.g., the instance dropped an idle
+  // keep-alive connection during a reused /run), fall back to the next
+  // start type
+  bool executed = umsesh->IsExecuted();
+  if (!executed) {
+    SEUSS_LOG_WARN("C(%lu) session closed before the response: tid=%lx\n",
+                   core_, umsesh->Stats().transaction_id);
+    stalled_instance_usage_count_.erase(umi_id);
+  }
+  umsesh->Finish(executed);
+  // The instance is not kept, kill it and free its port
+  release_session_port(umsesh);
+  halt_instance(umi_id);
+}
 
+void seuss::Invoker::SessionAborted(InvocationSession *umsesh) {
   /* Something went wrong. Kill the instance */
-  umsesh->WhenAborted().Then([this, umsesh, umi_id](auto f) {
-    umsesh->Finish(false);
-    ebbrt::event_manager->SpawnLocal(
-        [this, umi_id] { umm::manager->SignalHalt(umi_id); },
-        /* async */ true);
-  });
-
-  return umsesh;
+  if (umsesh->IsParked() ||
+      umsesh->GetPhase() == InvocationSession::Phase::finished) {
+    return;
+  }
+  auto umi_id = umsesh->InstanceId();
+  umsesh->Finish(false);
+  stalled_instance_usage_count_.erase(umi_id);
+  release_session_port(umsesh);
+  halt_instance(umi_id);
 }
 
@@ -9,26 +9,51 @@
 #error THIS IS EBBRT-NATIVE CODE
 #endif
 
+#include <array>
+#include <list>
+#include <map>
+#include <unordered_set>
+
 #include <ebbrt/Clock.h>
 #include <ebbrt/Debug.h>
 #include <ebbrt/Future.h>
 #include <ebbrt/MulticoreEbb.h>
 #include <ebbrt/SpinLock.h>
+#include <ebbrt/Timer.h>
 #include <ebbrt/UniqueIOBuf.h>
 #include <ebbrt/native/Multiboot.h>
 #include <ebbrt/native/Net.h>
 
 #include "umm/src/Umm.h"
 
+#include "AdaptiveConcurrency.h"
 #include "InvocationSession.h"
+#include "KeepAlivePolicy.h"
+#include "PortAllocator.h"
 #include "Seuss.h"
+#include "TimerWheel.h"
 
 namespace seuss {
 
-// cores * limit = total concurrent requests 
+// cores * limit = total concurrent requests (initial, adapted at runtime)
 const uint8_t default_concurrency_limit = 1; 
+const uint8_t default_concurrency_max = 64; // upper bound of adaptive limit
 const uint16_t default_instance_reuse_limit = 300; // hot start reuse 
 const uint32_t default_snapmap_limit = 32768; // snapshot cache size
+const uint16_t default_base_port = 49160; // first session source port
+const uint16_t default_session_pool_size = 64; // recycled sessions per core
+const uint32_t default_connect_timeout_ms = 5000; // session connect timeout
+const uint32_t default_run_timeout_ms = 60000; // unless the action sets one
+const uint8_t default_staged_base = 2; // staged base instances per core
+const uint8_t default_staged_functions = 4; // functions staged per core
+const uint32_t staged_decay_interval = 1024; // invocations per halving
+const uint8_t max_numa_nodes = 8;
+const uint8_t prewarm_batch = 4; // due pre-warms loaded per core per tick
+const uint16_t default_jit_warmup_runs = 0; // re-snapshot after N hot runs
+const uint32_t warm_snapshot_timeout_ms = 1000; // idle point must be reached
+/* Warm-up and prewarm snapshots are taken when the runtime next idles
+ * (solo5 ukvm) */
+const char *const warm_snapshot_symbol = "solo5_poll";
 
 void Init();
 
@@ -36,19 +61,60 @@ class Invoker;
 
 /*  suess::InvokerRoot
  *  Shared ebb responsible for the Invokers work queue and segregating IO
- * processing
+ *  processing. Only the work queues are sharded per NUMA node: cores take
+ *  work from their own node first, and work is only stolen from other nodes
+ *  as a fallback. Snapshots are not copied per node (that needs an
+ *  umm::UmSV copy of the pages), every node restores from the snapshot as
+ *  it was captured.
  */
 class InvokerRoot {
 public:
   InvokerRoot() {}
   void Bootstrap();
+  /* Boot the runtime twice to capture the base snapshot. Runs before
+   * Bootstrap(), while the other cores initialize. */
+  void BuildBaseSnapshot();
+  /* Record the NUMA node of an invoker core (from Invoker::Init) */
+  void RegisterCore(size_t core, size_t node);
+  /* Startup timeline, printed as each step completes */
+  void StartupMark(const char *event);
+  void FirstInvocation();
   size_t AddWork(Invocation i);
-  bool GetWork(Invocation &i);
+  /* Dequeue work, returns the time the request spent in the queue */
+  bool GetWork(Invocation &i, uint64_t &queue_us);
+  /* Is there work queued on this core's node? */
+  bool HasWork();
+  bool IsBootstrapped() { return is_bootstrapped_; }
   ebbrt::EbbRef<Invoker> ebb_;
+  /* Base and function snapshots */
   umm::UmSV *GetBaseSV();
   umm::UmSV *GetSnapshot(size_t id);
   bool SetSnapshot(size_t id, umm::UmSV *);
+  /* Claim the (single) post-warm-up re-snapshot of a function, and give
+   * the claim back if the snapshot could not be taken */
+  bool ClaimWarmSnapshot(size_t id);
+  void ReleaseWarmSnapshot(size_t id);
+  /* Swap in a snapshot taken after warm-up, later restores use it */
+  bool ReplaceSnapshot(size_t id, umm::UmSV *);
+  /* References held by the instances restored from a snapshot, replaced
+   * snapshots are freed once they have no instances left */
+  void RetainSnapshot(umm::UmSV *sv);
+  void ReleaseSnapshot(umm::UmSV *sv);
+  void FreeRetiredSnapshots(ebbrt::clock::Wall::time_point now);
   bool CacheIsFull() { return snapmap_.size() >= default_snapmap_limit; }
+  /* Keep-alive window derived from the function's arrival history */
+  KeepAliveWindow GetKeepAliveWindow(size_t fid);
+  /* Pre-warm schedule shared by the cores, a function's next arrival may
+   * land on any of them. Rescheduling a function replaces its entry. */
+  void SchedulePrewarm(size_t fid, ebbrt::clock::Wall::time_point load,
+                       ebbrt::clock::Wall::time_point expires);
+  /* Pop a pre-warm that is due, returns false if there is none */
+  bool TakeDuePrewarm(ebbrt::clock::Wall::time_point now, size_t &fid,
+                      ebbrt::clock::Wall::time_point &expires);
+  /* Core holding a pre-warmed instance of a function, arrivals of the
+   * function are sent to that core */
+  void SetPrewarmedCore(size_t fid, size_t core);
+  void ClearPrewarmedCore(size_t fid, size_t core);
 
 private:
   const std::string umi_rump_config_ =
@@ -56,14 +122,48 @@ private:
   umm::UmSV *base_um_env_;
   umm::UmSV *preinit_env_;
   bool is_bootstrapped_{false}; // Have we created a base snapshot?
-  ebbrt::SpinLock qlock_;
-  ebbrt::SpinLock snaplock_;
-  // map tid to Invocation{} .
-  std::unordered_map<uint64_t, Invocation> request_map_;
-  // Queue requests by tid
-  std::queue<uint64_t> request_queue_;
+  /* Per-NUMA-node work queue */
+  struct NodeShard {
+    ebbrt::SpinLock qlock;
+    // map tid to Invocation{} .
+    std::unordered_map<uint64_t, Invocation> request_map;
+    // Queue requests by tid (with enqueue time)
+    std::queue<std::pair<uint64_t, ebbrt::clock::Wall::time_point>>
+        request_queue;
+    std::vector<size_t> cores;
+  };
+  std::array<NodeShard, max_numa_nodes> shards_;
+  // Written under register_lock_, read without it by AddWork/GetWork
+  std::atomic<size_t> num_nodes_{1};
+  ebbrt::SpinLock register_lock_;
+  std::atomic<bool> first_invocation_{false};
+  std::atomic<size_t> next_node_{0}; // round-robin dispatch across nodes
+  bool node_has_cores(size_t node);
+  NodeShard &local_shard();
+  bool take_work(NodeShard &shard, Invocation &i, uint64_t &queue_us);
   // Shared snapshot cache
+  ebbrt::SpinLock snaplock_;
   std::unordered_map<size_t, umm::UmSV *> snapmap_;
+  // Functions with a post-warm-up snapshot (taken or in progress)
+  std::unordered_set<size_t> warm_snapshots_;
+  // Instances restored from each snapshot (still running or parked)
+  std::unordered_map<umm::UmSV *, size_t> snapshot_refs_;
+  // Replaced snapshots (with the time they were replaced), instances
+  // restored from them may share their pages
+  std::vector<std::pair<umm::UmSV *, ebbrt::clock::Wall::time_point>>
+      retired_snapshots_;
+  // Inter-arrival history of each function on this node
+  ebbrt::SpinLock arrival_lock_;
+  std::unordered_map<size_t, ArrivalHistogram> arrival_map_;
+  // Pre-warms ordered by load time: (fid, expiry of the instance)
+  typedef std::multimap<ebbrt::clock::Wall::time_point,
+                        std::pair<size_t, ebbrt::clock::Wall::time_point>>
+      prewarm_queue;
+  ebbrt::SpinLock prewarm_lock_;
+  prewarm_queue prewarm_due_;
+  std::unordered_map<size_t, prewarm_queue::iterator> prewarm_by_fid_;
+  std::unordered_map<size_t, size_t> prewarmed_core_; // fid to core
+  bool claim_prewarmed_core(size_t fid, size_t &core);
   friend class Invoker;
 }; // end class InvokerRoot
 
@@ -72,14 +172,16 @@ private:
  *  UM instances, executing the function code and, eventually, caching and
  *  redeploying instance snapshots.
  */
-class Invoker : public ebbrt::MulticoreEbb<Invoker, InvokerRoot> {
+class Invoker : public ebbrt::MulticoreEbb<Invoker, InvokerRoot>,
+                public ebbrt::Timer::Hook,
+                public InvocationSession::Handler {
 public:
   static const ebbrt::EbbId global_id = ebbrt::GenerateStaticEbbId("Invoker");
   explicit Invoker(const InvokerRoot &root)
       : root_(const_cast<InvokerRoot &>(root)), core_(ebbrt::Cpu::GetMine()),
-        base_port_(49160), port_(0), request_concurrency_(0) {
-    port_range_ = ((1 << 16) - base_port_ - 1);
-  };
+        ports_(default_base_port, ((1 << 16) - default_base_port - 1), core_,
+               ebbrt::Cpu::Count()),
+        request_concurrency_(0){};
 
   /* Start a new Invocation */
   void Invoke(Invocation i);
@@ -90,54 +192,169 @@ public:
   /* Add invocation request to work queue (but do no work) */
   void Queue(Invocation i);
 
+  /* Run an invocation on this core, it has a pre-warmed instance here */
+  void QueueLocal(Invocation i);
+
   /* Initialize invoker on this core*/
   void Init();
 
   /* Wake up, there's work to do! */
   void Poke();
 
+  /* Per-core timer: reap expired idle and staged instances, pre-warm others,
+   * and time out snapshots waiting for an idle point */
+  void Fire() override;
+
+  /* Load instances ahead of time while the core is idle */
+  void refill_staged_instances();
+
+  /* Session timeouts of this core */
+  TimerWheel &Timeouts() { return timeouts_; }
+
+  /* Session phase handlers */
+  void SessionConnected(InvocationSession *umsesh) override;
+  void SessionInitialized(InvocationSession *umsesh) override;
+  void SessionExecuted(InvocationSession *umsesh) override;
+  void SessionClosed(InvocationSession *umsesh) override;
+  void SessionAborted(InvocationSession *umsesh) override;
+
 private:
+  /* Try to start the invocation, falling back to the next start type */
+  void start_invocation(Invocation i, StartType type);
+  /* Invocation has left the core; make room for the next one */
+  void finish_invocation();
+
+  /* Each process_*_start resolves to the session status, or to false right
+   * away if the invocation cannot be served by that start type */
+  ebbrt::Future<bool> process_start(const Invocation &i, StartType type);
   /* Boot from the base snapshot and capture a new snapshot for this function*/
-  bool process_cold_start(Invocation i);
+  ebbrt::Future<bool> process_cold_start(const Invocation &i);
+  /* Initialize a function and snapshot it, without running it */
+  ebbrt::Future<bool> process_prewarm(Invocation i);
   /* Boot from function-specific snapshot */
-  bool process_warm_start(Invocation i);
+  ebbrt::Future<bool> process_warm_start(const Invocation &i);
   /* Connective to an active instance for this function */
-  bool process_hot_start(Invocation i);
+  ebbrt::Future<bool> process_hot_start(const Invocation &i);
+  /* Cache the function snapshot captured by a cold start */
+  void capture_snapshot(ebbrt::Future<umm::UmSV *> hot_sv_f,
+                        InvocationSession *umsesh);
+  /* Cache a function snapshot and tell the controller, false if it wasn't
+   * kept (already cached, or no room) */
+  bool cache_snapshot(size_t fid, umm::UmSV *sv);
+  /* Prewarms waiting for /init or for their snapshot: the function, the
+   * deadline for the snapshot (once initialized) and whether it was stored */
+  struct pending_prewarm {
+    size_t fid;
+    ebbrt::clock::Wall::time_point deadline;
+    ebbrt::Promise<bool> stored;
+  };
+  std::unordered_map<umm::umi::id, pending_prewarm> pending_prewarms_;
+  void finish_prewarm(umm::umi::id umi_id, bool stored);
+  /* Re-snapshot an instance that has warmed up (JIT compiled code) instead
+   * of parking it, returns false if it is not due for one */
+  bool capture_warm_snapshot(InvocationSession *umsesh);
+  // Warm-up snapshots waiting for their instance to idle: fid and deadline
+  std::unordered_map<umm::umi::id,
+                     std::pair<size_t, ebbrt::clock::Wall::time_point>>
+      pending_warm_snapshots_;
+  /* Restore an instance from a function snapshot, and halt instances */
+  std::unique_ptr<umm::UmInstance> restore_instance(umm::UmSV *sv);
+  void halt_instance(umm::umi::id umi_id);
+  // Snapshot each restored instance was made from
+  std::unordered_map<umm::umi::id, umm::UmSV *> instance_snapshot_;
+  /* start -> connect: run a loaded instance and connect to it */
+  void start_instance(InvocationSession *umsesh, umm::umi::id umi_id);
+  /* close: release the session once finished, resolves to its status */
+  ebbrt::Future<bool> when_session_finished(InvocationSession *umsesh);
   
   /* Returns a new session handler with the callbacks set */
-  InvocationSession *new_invocation_session(seuss::InvocationStats *istats,
+  InvocationSession *new_invocation_session(seuss::InvocationStats istats,
                                const size_t fid,
                                const umm::umi::id umi_id,
-                               const std::string args,
-                               const std::string code = std::string());
+                               std::string args,
+                               std::string code = std::string(),
+                               uint16_t src_port = 0);
+  /* Set the payload and handler of a new or reused session */
+  void arm_invocation_session(InvocationSession *umsesh,
+                              seuss::InvocationStats istats, const size_t fid,
+                              const umm::umi::id umi_id, std::string args,
+                              std::string code = std::string());
+  /* Free a session (and its port) that will not be reused */
+  void discard_session(InvocationSession *umsesh);
+  /* Disconnect a session and release its source port */
+  void release_session_port(InvocationSession *umsesh);
+  /* Per-core session pool, sessions are reset and recycled */
+  InvocationSession *alloc_session(uint16_t src_port);
+  void recycle_session(InvocationSession *umsesh);
+  std::vector<InvocationSession *> session_pool_;
+  /* Spare PCBs for recycled sessions, made ahead of time while idle */
+  ebbrt::NetworkManager::TcpPcb take_pcb();
+  void refill_pcb_pool();
+  std::vector<ebbrt::NetworkManager::TcpPcb> pcb_pool_;
+  TimerWheel timeouts_;
   /* Concurrency management (i.e., instances blocked on IO )*/
-  uint16_t request_concurrency_limit_ = default_concurrency_limit;
+  AdaptiveConcurrency concurrency_{default_concurrency_limit,
+                                   default_concurrency_max};
   /* Hot start management  */
   bool hot_instances_are_enabled() { return hot_instance_limit_; }
-  /* Return true if instance was saved */
-  bool save_hot_instance(size_t fid, umm::umi::id id);
+  /* Return true if instance (and its idle session) was saved */
+  bool save_hot_instance(size_t fid, umm::umi::id id,
+                         InvocationSession *umsesh);
   bool hot_instance_exists(size_t fid);
-  bool hot_instance_can_be_saved(umm::umi::id id);
   bool hot_instance_can_be_reused(umm::umi::id id);
-  umm::umi::id get_hot_instance(size_t fid);
+  umm::umi::id get_hot_instance(size_t fid, InvocationSession *&umsesh);
+  /* Halt the least-recently-used idle instance on this core */
+  void evict_hot_instance();
+  /* Load an instance from snapshot ahead of a function's expected arrival */
+  void prewarm_instance(size_t fid, ebbrt::clock::Wall::time_point expires);
+  umm::umi::id get_prewarmed_instance(size_t fid, uint16_t &port);
+  /* Instances loaded ahead of time register their port before the load */
+  struct loaded_instance {
+    umm::umi::id umi_id;
+    uint16_t port;
+  };
+  /* Reserve a port for an instance that is about to be loaded */
+  uint16_t register_instance_port(umm::UmInstance &umi);
+  /* Halt a loaded instance that was never started */
+  void release_loaded_instance(loaded_instance inst);
+  /* Staged instances (loaded, not started), refilled when idle and halted
+   * after the keep-alive window of an idle instance */
+  struct staged_instance {
+    loaded_instance inst;
+    ebbrt::Future<umm::UmSV *> snapshot; // checkpoint set before the load
+    bool ready;                          // load has completed
+    ebbrt::clock::Wall::time_point expires;
+  };
+  struct staged_warm_instance {
+    loaded_instance inst;
+    ebbrt::clock::Wall::time_point expires;
+  };
+  std::vector<staged_instance> staged_base_;
+  std::unordered_map<size_t, staged_warm_instance> staged_warm_; // by fid
+  bool staging_ = false; // a staged load is in flight
+  bool stage_base_ = true; // cleared when staged base instances go unused
+  umm::umi::id take_staged_warm(size_t fid, uint16_t &port);
+  /* Halt the staged instances whose keep-alive window has expired */
+  void reap_staged_instances(ebbrt::clock::Wall::time_point now);
+  /* Popularity of each function on this core (decayed invocation counts) */
+  void record_function_hit(size_t fid);
+  std::vector<size_t> top_functions(size_t k);
+  std::unordered_map<size_t, uint32_t> function_hits_;
+  uint32_t hits_since_decay_ = 0;
   //TODO:(jmcadden): rename spicy -> hot
   uint16_t hot_instance_limit_ = 0;
   uint16_t hot_instance_reuse_limit_ = default_instance_reuse_limit;
+  uint16_t jit_warmup_runs_ = default_jit_warmup_runs;
   
 
   InvokerRoot &root_;
   size_t core_; 
-  const uint16_t base_port_;
-  uint16_t port_range_; // port should be between base_port_ and MAX_UINT_16
-  std::atomic<std::uint16_t> port_;
-  uint16_t get_internal_port() {
-    port_ += ebbrt::Cpu::Count();
-    size_t port_offset = (size_t)ebbrt::Cpu::GetMine();
-    return base_port_ + ((port_ + port_offset) % port_range_);
-  }
+  // Session source ports owned by this core
+  PortAllocator ports_;
+  uint16_t get_internal_port();
   /* Counters */
   uint64_t invctr_ = 0;
-  std::atomic<std::uint8_t> request_concurrency_;
+  std::atomic<std::uint16_t> request_concurrency_;
   // Arg code pair
   typedef std::tuple<size_t, std::string, std::string> invocation_request;
   // map tid to (arg, code) pairs.
@@ -145,9 +362,39 @@ private:
   // Queue requests by tid
   std::queue<uint64_t> request_queue_;
   // Hot & Spicy starts
-  std::unordered_map<size_t, umm::umi::id> stalled_instance_map_;
-  std::deque<size_t> stalled_instance_fifo_;
+  struct hot_instance;
+  typedef std::list<hot_instance> hot_instance_lru;
+  // Idle instances of a single function
+  typedef std::list<hot_instance_lru::iterator> hot_instance_list;
+  // Idle instances ordered by the end of their keep-alive window
+  typedef std::multimap<ebbrt::clock::Wall::time_point,
+                        hot_instance_lru::iterator>
+      hot_instance_expiry;
+  struct hot_instance {
+    size_t fid;
+    umm::umi::id umi_id;
+    InvocationSession *session; // idle keep-alive connection (and its port)
+    hot_instance_list::iterator fn_pos; // entry in stalled_instance_map_
+    hot_instance_expiry::iterator expiry_pos; // entry in stalled_expiry_
+  };
+  void release_hot_instance(hot_instance_lru::iterator lru_it);
+  // Idle instances in least-recently-used order (LRU at the front)
+  hot_instance_lru stalled_instance_lru_;
+  // map fid to its idle instances, most-recently-saved at the back
+  std::unordered_map<size_t, hot_instance_list> stalled_instance_map_;
+  hot_instance_expiry stalled_expiry_;
   std::unordered_map<umm::umi::id, uint16_t> stalled_instance_usage_count_;
+  // Pre-warmed (loaded, not started) instances, ordered by expiry
+  typedef std::multimap<ebbrt::clock::Wall::time_point, size_t>
+      prewarmed_expiry;
+  // map fid to (instance, expiry)
+  std::unordered_map<size_t,
+                     std::pair<loaded_instance, prewarmed_expiry::iterator>>
+      prewarmed_instance_map_;
+  prewarmed_expiry prewarmed_expiry_;
+  // Invocations sent to this core for its pre-warmed instances
+  std::queue<std::pair<Invocation, ebbrt::clock::Wall::time_point>>
+      local_work_;
 };
 
 constexpr auto invoker = ebbrt::EbbRef<Invoker>(Invoker::global_id);
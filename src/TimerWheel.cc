@@ -0,0 +1,124 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <ebbrt/Debug.h>
+
+#include "TimerWheel.h"
+
+void seuss::TimerWheel::Arm(Entry &e, std::chrono::milliseconds timeout) {
+  Cancel(e);
+  auto now = ebbrt::clock::Wall::Now();
+  if (armed_ == 0) {
+    // Nothing is pending, the wheel can skip ahead to the current time
+    tick_ = clock_tick(now);
+  }
+  uint64_t ticks = (timeout.count() + timer_wheel_tick_ms - 1) /
+                   timer_wheel_tick_ms;
+  e.expires_ = clock_tick(now) + ((ticks > 0) ? ticks : 1);
+  if (e.expires_ <= tick_)
+    e.expires_ = tick_ + 1;
+  e.wheel_ = this;
+  insert(e);
+  armed_++;
+  schedule();
+}
+
+void seuss::TimerWheel::Cancel(Entry &e) {
+  if (!e.wheel_)
+    return;
+  kassert(e.wheel_ == this);
+  unlink(e);
+}
+
+void seuss::TimerWheel::Fire() {
+  running_ = false;
+  auto target = clock_tick(ebbrt::clock::Wall::Now());
+  while (tick_ < target && armed_ > 0) {
+    tick_++;
+    // Cascade the coarser levels whose slot has come around, highest first
+    uint8_t top = 0;
+    while (top + 1 < timer_wheel_levels &&
+           (tick_ & ((1ull << (timer_wheel_bits * (top + 1))) - 1)) == 0) {
+      top++;
+    }
+    for (uint8_t level = top; level > 0; level--) {
+      cascade(level);
+    }
+    expire_current();
+  }
+  if (armed_ == 0 && tick_ < target)
+    tick_ = target;
+  schedule();
+}
+
+uint64_t
+seuss::TimerWheel::clock_tick(ebbrt::clock::Wall::time_point now) const {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(now - start_)
+             .count() /
+         timer_wheel_tick_ms;
+}
+
+void seuss::TimerWheel::insert(Entry &e) {
+  // Entries expiring on the current tick are placed in the current slot
+  kassert(e.expires_ >= tick_);
+  uint64_t delta = e.expires_ - tick_;
+  uint8_t level = 0;
+  while (level + 1 < timer_wheel_levels &&
+         delta >= (1ull << (timer_wheel_bits * (level + 1)))) {
+    level++;
+  }
+  uint64_t range = 1ull << (timer_wheel_bits * timer_wheel_levels);
+  if (delta >= range) {
+    // Beyond the range of the wheel, expire at its far end
+    e.expires_ = tick_ + range - 1;
+  }
+  auto index =
+      (e.expires_ >> (timer_wheel_bits * level)) & (timer_wheel_slots - 1);
+  auto &head = slot(level, index);
+  e.next_ = head;
+  if (head)
+    head->pprev_ = &e.next_;
+  e.pprev_ = &head;
+  head = &e;
+}
+
+void seuss::TimerWheel::unlink(Entry &e) {
+  *e.pprev_ = e.next_;
+  if (e.next_)
+    e.next_->pprev_ = e.pprev_;
+  e.next_ = nullptr;
+  e.pprev_ = nullptr;
+  e.wheel_ = nullptr;
+  armed_--;
+}
+
+void seuss::TimerWheel::cascade(uint8_t level) {
+  auto index = (tick_ >> (timer_wheel_bits * level)) & (timer_wheel_slots - 1);
+  auto &head = slot(level, index);
+  Entry *e = head;
+  head = nullptr;
+  while (e) {
+    auto next = e->next_;
+    insert(*e); // lands on a lower level
+    e = next;
+  }
+}
+
+void seuss::TimerWheel::expire_current() {
+  auto &head = slot(0, tick_ & (timer_wheel_slots - 1));
+  // Expire() may arm or cancel other entries, so always restart at the head
+  while (head) {
+    auto e = head;
+    unlink(*e);
+    e->Expire();
+  }
+}
+
+void seuss::TimerWheel::schedule() {
+  if (running_ || armed_ == 0)
+    return;
+  ebbrt::timer->Start(*this, std::chrono::milliseconds(timer_wheel_tick_ms),
+                      /* repeat = */ false);
+  running_ = true;
+}
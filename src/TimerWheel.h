@@ -0,0 +1,83 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_TIMER_WHEEL_H
+#define SEUSS_TIMER_WHEEL_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+
+#include <ebbrt/Clock.h>
+#include <ebbrt/Timer.h>
+
+namespace seuss {
+
+/* Wheel geometry: 10ms ticks, 4 levels of 64 slots (~46 hours range) */
+const uint32_t timer_wheel_tick_ms = 10;
+const uint8_t timer_wheel_bits = 6;
+const uint8_t timer_wheel_levels = 4;
+const uint32_t timer_wheel_slots = 1 << timer_wheel_bits;
+
+/* seuss::TimerWheel
+ * Per-core hierarchical timing wheel for session timeouts. Entries are
+ * intrusive, so arming and cancelling a timeout is O(1) and does not
+ * allocate. Each level is timer_wheel_slots times coarser than the one below
+ * it, entries cascade down a level as the wheel turns. A single ebbrt timer
+ * drives the wheel, and only while it holds entries.
+ * Not thread-safe; entries must be armed and cancelled on the wheel's core.
+ */
+class TimerWheel : public ebbrt::Timer::Hook {
+public:
+  class Entry {
+  public:
+    virtual ~Entry() {
+      if (wheel_)
+        wheel_->Cancel(*this);
+    }
+    /* Called (once) from the wheel when the timeout expires */
+    virtual void Expire() = 0;
+    bool IsArmed() const { return wheel_ != nullptr; }
+
+  private:
+    TimerWheel *wheel_ = nullptr;
+    Entry *next_ = nullptr;
+    Entry **pprev_ = nullptr; // link that points at this entry
+    uint64_t expires_ = 0;    // tick
+    friend class TimerWheel;
+  };
+
+  TimerWheel() : start_(ebbrt::clock::Wall::Now()) { slots_.fill(nullptr); }
+
+  /* (Re)arm the entry to expire after the timeout */
+  void Arm(Entry &e, std::chrono::milliseconds timeout);
+
+  /* Disarm the entry, a no-op if it is not armed */
+  void Cancel(Entry &e);
+
+  /* Number of armed entries */
+  size_t Armed() const { return armed_; }
+
+  /* Turn the wheel up to the current time */
+  void Fire() override;
+
+private:
+  uint64_t clock_tick(ebbrt::clock::Wall::time_point now) const;
+  void insert(Entry &e);
+  void unlink(Entry &e);
+  void cascade(uint8_t level);
+  void expire_current();
+  void schedule();
+  Entry *&slot(uint8_t level, size_t index) {
+    return slots_[level * timer_wheel_slots + index];
+  }
+  ebbrt::clock::Wall::time_point start_;
+  uint64_t tick_ = 0; // last tick processed
+  size_t armed_ = 0;
+  bool running_ = false;
+  std::array<Entry *, timer_wheel_levels * timer_wheel_slots> slots_;
+}; // end class TimerWheel
+
+} // end namespace seuss
+#endif
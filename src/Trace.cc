@@ -0,0 +1,129 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#include <csignal>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Trace.h"
+
+std::atomic<bool> seuss::trace::enabled{false};
+
+namespace {
+/* Chrome trace process ids */
+const int controller_pid = 1;
+const int node_pid = 2;
+/* How often the dump request flag is checked */
+const uint32_t dump_poll_ms = 100;
+
+struct span {
+  uint64_t tid;
+  const char *name;
+  int pid;
+  uint64_t ts_us;
+  uint64_t dur_us;
+};
+
+std::mutex spans_lock;
+std::vector<span> spans;
+size_t next_span = 0; // oldest span once the buffer has wrapped
+std::atomic<bool> dump_requested{false};
+
+uint64_t to_us(seuss::trace::time_point tp) {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             tp.time_since_epoch())
+      .count();
+}
+
+void record(uint64_t tid, const char *name, int pid, uint64_t ts_us,
+            uint64_t dur_us) {
+  std::lock_guard<std::mutex> guard(spans_lock);
+  span s = {tid, name, pid, ts_us, dur_us};
+  if (spans.size() < seuss::trace::max_spans) {
+    spans.push_back(s);
+  } else {
+    spans[next_span] = s;
+    next_span = (next_span + 1) % seuss::trace::max_spans;
+  }
+}
+
+void request_dump(int) { dump_requested = true; }
+} // end local namespace
+
+void seuss::trace::Init(const std::string &path) {
+  if (path.empty() || enabled)
+    return;
+  spans.reserve(max_spans);
+  enabled = true;
+  std::signal(SIGUSR1, request_dump);
+  std::thread([path] {
+    while (true) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(dump_poll_ms));
+      if (dump_requested.exchange(false)) {
+        if (Dump(path))
+          std::cout << "Trace written to " << path << std::endl;
+      }
+    }
+  }).detach();
+  std::cout << "Tracing enabled, send SIGUSR1 to write " << path << std::endl;
+}
+
+void seuss::trace::Span(uint64_t tid, const char *name, time_point start,
+                        time_point end) {
+  if (!Enabled())
+    return;
+  auto ts = to_us(start);
+  auto te = to_us(end);
+  record(tid, name, controller_pid, ts, (te > ts) ? te - ts : 0);
+}
+
+void seuss::trace::NodeSpans(const InvocationStats &istats, time_point reply) {
+  if (!Enabled())
+    return;
+  auto &us = istats.exec.us;
+  // Node phases in the order they occur
+  const std::pair<const char *, uint32_t> phases[] = {
+      {"node.queue", us.queue},     {"node.load", us.load},
+      {"node.start", us.start},     {"node.connect", us.connect},
+      {"node.init", us.init},       {"node.run", us.run}};
+  uint64_t total = 0;
+  for (auto &p : phases)
+    total += p.second;
+  auto ts = to_us(reply) - total;
+  for (auto &p : phases) {
+    if (p.second > 0)
+      record(istats.transaction_id, p.first, node_pid, ts, p.second);
+    ts += p.second;
+  }
+}
+
+bool seuss::trace::Dump(const std::string &path) {
+  std::vector<span> copy;
+  {
+    std::lock_guard<std::mutex> guard(spans_lock);
+    copy = spans;
+  }
+  std::ofstream out(path, std::ofstream::trunc);
+  if (!out.good()) {
+    std::cerr << "Unable to open trace file: " << path << std::endl;
+    return false;
+  }
+  out << R"({"displayTimeUnit":"ms","traceEvents":[)";
+  out << R"({"name":"process_name","ph":"M","pid":)" << controller_pid
+      << R"(,"args":{"name":"controller"}},)";
+  out << R"({"name":"process_name","ph":"M","pid":)" << node_pid
+      << R"(,"args":{"name":"native node"}})";
+  for (auto &s : copy) {
+    // One row per activation, keyed by (a JSON-safe part of) its id
+    out << R"(,{"name":")" << s.name << R"(","ph":"X","pid":)" << s.pid
+        << R"(,"tid":)" << (s.tid & 0xffffffff) << R"(,"ts":)" << s.ts_us
+        << R"(,"dur":)" << s.dur_us << R"(,"args":{"transaction_id":")"
+        << s.tid << R"("}})";
+  }
+  out << "]}" << std::endl;
+  return out.good();
+}
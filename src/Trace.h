@@ -0,0 +1,61 @@
+//          Copyright Boston University SESA Group 2013 - 2018.
+// Distributed under the Boost Software License, Version 1.0.
+//    (See accompanying file LICENSE_1_0.txt or copy at
+//          http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SEUSS_TRACE_H
+#define SEUSS_TRACE_H
+
+#if __ebbrt__
+#error THIS IS LINUX-ONLY CODE
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+
+#include "Seuss.h"
+
+/** Trace.h
+ * Per-activation spans, written as a Chrome/Perfetto trace (JSON) on
+ * SIGUSR1. Spans are keyed by the transaction id and kept in a bounded
+ * buffer, the oldest spans are overwritten. Native node spans are rebuilt
+ * from the phase times carried back in the reply.
+ */
+
+namespace seuss {
+namespace trace {
+
+/* Spans kept in the buffer */
+const size_t max_spans = 1 << 16;
+
+typedef std::chrono::system_clock::time_point time_point;
+
+inline time_point Now() { return std::chrono::system_clock::now(); }
+
+/* Transaction id of an OpenWhisk activation */
+inline uint64_t TransactionId(const std::string &transid) {
+  return std::hash<std::string>{}(transid);
+}
+
+/* True once Init() was given a trace file */
+extern std::atomic<bool> enabled;
+inline bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+
+/* Enable tracing, the trace is written to path on SIGUSR1 */
+void Init(const std::string &path);
+
+/* Record a span of the controller (name must be a literal) */
+void Span(uint64_t tid, const char *name, time_point start, time_point end);
+
+/* Record the native node spans of a finished activation, laid out back to
+ * back and ending at the time the reply was received */
+void NodeSpans(const InvocationStats &istats, time_point reply);
+
+/* Write the buffered spans as Chrome trace JSON */
+bool Dump(const std::string &path);
+
+} // end namespace trace
+} // end namespace seuss
+#endif
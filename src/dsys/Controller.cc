@@ -1,16 +1,30 @@
 // Distributed under the Boost Software License, Version 1.0.
 //    (See accompanying file LICENSE_1_0.txt or copy at
 //          http://www.boost.org/LICENSE_1_0.txt)
+#include <atomic>
 #include <iostream>
+#include <memory>
 #include "Controller.h"
 
 #ifndef __ebbrt__
 #include "../SeussController.h"
 
+namespace {
+double seconds_since(const struct timeval &start) {
+  struct timeval now;
+  gettimeofday(&now, NULL);
+  return (now.tv_sec - start.tv_sec) +
+         ((now.tv_usec - start.tv_usec) / 1000000.0);
+}
+} // end local namespace
+
 void
-ebbrt::dsys::Controller::AllocateNativeInstances(std::string binary_path) {
+ebbrt::dsys::Controller::AllocateNativeInstances(std::string binary_path,
+                                                 size_t count) {
 
   assert(!binary_path.empty());
+  if (!count)
+    return;
   struct timeval START_TIME;
   gettimeofday(&START_TIME, NULL);
   ebbrt::NodeAllocator::NodeArgs args;
@@ -26,20 +40,32 @@ ebbrt::dsys::Controller::AllocateNativeInstances(std::string binary_path) {
 
   // Set CmdArgs for the InvokerCore Ebb
   ebbrt::node_allocator->AppendArgs("Clim=" + std::to_string(native_invoker_core_concurrency_limit));
+  ebbrt::node_allocator->AppendArgs("Cmax=" + std::to_string(native_invoker_core_concurrency_max));
   ebbrt::node_allocator->AppendArgs("Slim=" + std::to_string(native_invoker_core_spicy_limit));
+  ebbrt::node_allocator->AppendArgs("Log=" + std::to_string(log_level));
   if(native_invoker_core_spicy_limit && native_invoker_core_spicy_reuse)
     ebbrt::node_allocator->AppendArgs("Rlim=" + std::to_string(native_invoker_core_spicy_reuse));
+  if(native_invoker_core_spicy_limit && native_invoker_core_jit_warmup)
+    ebbrt::node_allocator->AppendArgs("Jlim=" + std::to_string(native_invoker_core_jit_warmup));
 
-  auto node_desc = ebbrt::node_allocator->AllocateNode(binary_path, args);
-  node_desc.NetworkId().Then([START_TIME](
-      ebbrt::Future<ebbrt::Messenger::NetworkId> f) {
-      struct timeval END_TIME;
-      gettimeofday(&END_TIME, NULL);
-      std::printf("ALLOCATION TIME: %lf seconds\n",
-                  (END_TIME.tv_sec - START_TIME.tv_sec) +
-                      ((END_TIME.tv_usec - START_TIME.tv_usec) / 1000000.0));
-      seuss::controller->RegisterNode(f.Get());
-  });
-  node_descriptors_.emplace_back(std::move(node_desc));
+  // Nodes are launched one at a time, the NodeAllocator isn't known to be
+  // safe to call concurrently. AllocateNode returns once the node is
+  // launched, so only the boots and registrations overlap
+  auto pending = std::make_shared<std::atomic<size_t>>(count);
+  for (size_t i = 0; i < count; i++) {
+    auto node_desc = ebbrt::node_allocator->AllocateNode(binary_path, args);
+    std::printf("NODE %zu LAUNCHED: %lf seconds\n", i,
+                seconds_since(START_TIME));
+    node_desc.NetworkId().Then([START_TIME, pending, i](
+        ebbrt::Future<ebbrt::Messenger::NetworkId> f) {
+        std::printf("ALLOCATION TIME (node %zu): %lf seconds\n", i,
+                    seconds_since(START_TIME));
+        if (--*pending == 0)
+          std::printf("ALL NODES ALLOCATED: %lf seconds\n",
+                      seconds_since(START_TIME));
+        seuss::controller->RegisterNode(f.Get());
+    });
+    node_descriptors_.emplace_back(std::move(node_desc));
+  }
 }
 #endif
@@ -31,7 +31,8 @@ public:
   Controller(ebbrt::EbbId id) {};
   
 #ifndef __ebbrt__
-  void AllocateNativeInstances(std::string binary_path);
+  /* Launch native nodes one at a time, they boot concurrently */
+  void AllocateNativeInstances(std::string binary_path, size_t count);
   std::vector<ebbrt::NodeAllocator::NodeDescriptor> node_descriptors_;
 #endif
 
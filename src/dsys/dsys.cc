@@ -12,8 +12,11 @@ uint16_t ebbrt::dsys::native_numa_count;
 uint16_t ebbrt::dsys::native_memory_gb;
 // Seuss Invoker configuration 
 uint16_t ebbrt::dsys::native_invoker_core_concurrency_limit;
+uint16_t ebbrt::dsys::native_invoker_core_concurrency_max;
 uint16_t ebbrt::dsys::native_invoker_core_spicy_limit;
 uint16_t ebbrt::dsys::native_invoker_core_spicy_reuse;
+uint16_t ebbrt::dsys::native_invoker_core_jit_warmup;
+uint16_t ebbrt::dsys::log_level;
 bool ebbrt::dsys::local_init;
 
 void ebbrt::dsys::Init(){
@@ -21,10 +24,8 @@ void ebbrt::dsys::Init(){
   Controller::Create(tr, Controller::global_id);
 #if __ebbrt__ 
 #else
-  auto count = native_instance_count;
-  while(count--){
-    controller->AllocateNativeInstances(native_binary_path);
-  }
+  controller->AllocateNativeInstances(native_binary_path,
+                                      native_instance_count);
 #endif
   local_init = true;
 }
@@ -33,9 +34,12 @@ void ebbrt::dsys::Init(){
 po::options_description ebbrt::dsys::program_options() {
 
   po::options_description po("Invoker configuration (native)");
-  po.add_options()("concurrency-limit,C", po::value<uint16_t>(&native_invoker_core_concurrency_limit)->default_value(12), "Max amount of blocked requests to maintain per core");
+  po.add_options()("concurrency-limit,C", po::value<uint16_t>(&native_invoker_core_concurrency_limit)->default_value(12), "Initial amount of blocked requests to maintain per core (adapted at runtime)");
+  po.add_options()("concurrency-max,M", po::value<uint16_t>(&native_invoker_core_concurrency_max)->default_value(64), "Upper bound of the adaptive per-core concurrency limit");
   po.add_options()("spicy-limit,S", po::value<uint16_t>(&native_invoker_core_spicy_limit)->default_value(0), "Number of idle instances to maintain per core (spicy starts)");
   po.add_options()("reuse-limit,R", po::value<uint16_t>(&native_invoker_core_spicy_reuse)->default_value(300), "Number of times to reuse an active instance (for S>0)");
+  po.add_options()("jit-warmup,J", po::value<uint16_t>(&native_invoker_core_jit_warmup)->default_value(0), "Re-snapshot a function after its active instance ran this many times (for S>0, 0=never)");
+  po.add_options()("log-level,L", po::value<uint16_t>(&log_level)->default_value(1), "Log level of the hot paths, native and hosted (0=error 1=warn 2=info 3=debug)");
 
   po::options_description options("EbbRT configuration");
   options.add_options()("natives,n", po::value<uint16_t>(&native_instance_count)->default_value(1),
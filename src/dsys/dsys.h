@@ -36,8 +36,11 @@ extern uint16_t native_memory_gb;
 extern uint16_t native_numa_count;
 // Seuss Invoker configuration 
 extern uint16_t native_invoker_core_concurrency_limit;
+extern uint16_t native_invoker_core_concurrency_max;
 extern uint16_t native_invoker_core_spicy_limit;
 extern uint16_t native_invoker_core_spicy_reuse;
+extern uint16_t native_invoker_core_jit_warmup;
+extern uint16_t log_level; // hot path log level (seuss::log::Level)
 
 extern bool local_init;
 
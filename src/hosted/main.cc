@@ -21,6 +21,7 @@ namespace po = boost::program_options;
 #include <ebbrt/Cpu.h> // ebbrt::Cpu::EarlyInit
 #include "../dsys/dsys.h"
 #include "../openwhisk/openwhisk.h"
+#include "../Trace.h"
 
 int main(int argc, char **argv) {
   std::cout << "********************************************" << std::endl;
@@ -38,6 +39,10 @@ int main(int argc, char **argv) {
   po.add_options()("invoker-delay,d", po::value<uint64_t>()->default_value(0), "Sleep time between invocations (ms)");
   po.add_options()("file,f", po::value<std::string>(),
                         "javascript function (benchmark mode)");
+  po.add_options()("prewarm", po::bool_switch(&openwhisk::prewarm),
+                   "Snapshot the functions before each run (benchmark mode)");
+  po.add_options()("trace-file", po::value<std::string>(),
+                   "Record activation spans, written to this file (Chrome trace JSON) on SIGUSR1");
 
   // ebbrt dsys instance options 
   po.add(ebbrt::dsys::program_options()); 
@@ -63,6 +68,10 @@ int main(int argc, char **argv) {
     std::cout << "Seuss Invoker Mode: " << openwhisk::mode << std::endl;
   }
 
+  if (povm.count("trace-file")) {
+    seuss::trace::Init(povm["trace-file"].as<std::string>());
+  }
+
   if (openwhisk::mode == "default" || openwhisk::mode == "null") {
     /** Initialize openwhisk with input arguments */
     if (!openwhisk::process_program_options(povm)) {
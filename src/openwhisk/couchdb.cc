@@ -25,6 +25,7 @@ string couchdb_db_auth;
 string couchdb_db_entity;
 string couchdb_db_activation;
 std::unordered_map<std::string, std::string> db_cache;
+std::unordered_map<std::string, uint32_t> db_timeout_cache;
 } // end local namespace
 
 po::options_description openwhisk::couchdb::program_options() {
@@ -84,6 +85,7 @@ std::string openwhisk::couchdb::get_action( openwhisk::msg::Action action ){
   cout << "Raw DB reponse: " << response->raw_json << endl;
 
   const char *json_code_path[] = {"exec", "code", (const char *)0};
+  const char *json_timeout_path[] = {"limits", "timeout", (const char *)0};
   char errbuf[1024];
   yajl_val yv;
 
@@ -96,6 +98,9 @@ std::string openwhisk::couchdb::get_action( openwhisk::msg::Action action ){
   yv = yajl_tree_get(yajl_node, json_code_path, yajl_t_string);
   if (yv)
     function_code = YAJL_GET_STRING(yv);
+  yv = yajl_tree_get(yajl_node, json_timeout_path, yajl_t_number);
+  if (yv && YAJL_IS_INTEGER(yv) && YAJL_GET_INTEGER(yv) > 0)
+    db_timeout_cache.emplace(key, (uint32_t)YAJL_GET_INTEGER(yv));
 
   yajl_tree_free(yajl_node);
 
@@ -103,3 +108,11 @@ std::string openwhisk::couchdb::get_action( openwhisk::msg::Action action ){
   db_cache.emplace(key, function_code);
   return function_code;
 }
+
+uint32_t openwhisk::couchdb::get_action_timeout(openwhisk::msg::Action action) {
+  std::string key = action.path_ + action.name_ + action.version_;
+  auto it = db_timeout_cache.find(key);
+  if (it == db_timeout_cache.end())
+    return 0;
+  return it->second;
+}
@@ -7,6 +7,7 @@
 
 #include <ebbrt/Cpu.h>
 #include "../SeussController.h"
+#include "../Trace.h"
 
 #include "openwhisk.h"
 
@@ -141,9 +142,12 @@ void openwhisk::kafka::activation_consumer_loop() {
         }
       } else {
         // Get the message payload
+        auto received = seuss::trace::Now();
         std::string amjson = msg.get_payload();
         kafka_consumer.async_commit(msg);
         msg::ActivationMessage am(amjson);
+        auto tid = seuss::trace::TransactionId(am.transid_.name_);
+        seuss::trace::Span(tid, "kafka.receive", received, seuss::trace::Now());
         std::time_t result = std::time(nullptr);
         cout << std::asctime(std::localtime(&result)) << result
              << " got activation " << am.transid_.name_ << endl;
@@ -172,13 +176,16 @@ void openwhisk::kafka::activation_consumer_loop() {
             // Send request to the seuss controller
             auto cmf = seuss::controller->ScheduleActivation(am);
             cmf.Then(
-                [&kafka_producer](ebbrt::Future<msg::CompletionMessage> cmf) {
+                [&kafka_producer, tid](ebbrt::Future<msg::CompletionMessage> cmf) {
+                  auto produce_start = seuss::trace::Now();
                   auto cm = cmf.Get();
                   cm.invoker_.instance_ = invoker_id;
                   MessageBuilder builder("completed0");
                   auto pl = cm.to_json();
                   builder.payload(pl);
                   kafka_producer.produce(builder);
+                  seuss::trace::Span(tid, "kafka.produce", produce_start,
+                                     seuss::trace::Now());
                 });
           }
         } // end if(mode=null)
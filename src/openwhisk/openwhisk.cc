@@ -9,6 +9,7 @@
 
 #include <cstdlib>
 #include <algorithm>
+#include <unordered_set>
 
 #include "openwhisk.h"
 #include <ebbrt/Cpu.h>
@@ -18,6 +19,7 @@
 
 std::string openwhisk::mode = "";
 std::string openwhisk::function = "";
+bool openwhisk::prewarm = false;
 using namespace std;
 
 po::options_description openwhisk::program_options() {
@@ -128,6 +130,19 @@ void openwhisk::test() {
 
           assert(revisionVec.size() == (unsigned)b.runs);
 
+          // The functions are known before the run, snapshot them ahead of
+          // their first activation
+          if (openwhisk::prewarm) {
+            std::unordered_set<std::string> seen;
+            for (const std::string &re : revisionVec) {
+              if (!seen.insert(re).second)
+                continue;
+              auto am_tmp = am;
+              am_tmp.revision_ = re;
+              seuss::controller->Prewarm(am_tmp, code);
+            }
+          }
+
           int i = 0;
           for(const std::string& re : revisionVec){
             i++;
@@ -23,6 +23,7 @@ namespace openwhisk {
 // arguments configure via the command line
 extern std::string mode;
 extern std::string function;
+extern bool prewarm;
 
 // a 'dummy' OpenWhisk activation (benchmark)
 const std::string amjson =
@@ -49,6 +50,8 @@ namespace couchdb {
   bool init(po::variables_map &vm);
   po::options_description program_options();
   std::string get_action(msg::Action action);
+  /* Time limit of a fetched action in ms, 0 if not known */
+  uint32_t get_action_timeout(msg::Action action);
 } // end namespace couchdb
 
 /* Openwhisk options & setup */